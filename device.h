@@ -31,161 +31,166 @@ enum deviceflags {
 	DEVICE_HAS_ROOMEQ = 1 << 1,
 };
 
-enum control {
-	UNKNOWN,
-	INPUT_MUTE,
-	INPUT_FXSEND,
-	INPUT_STEREO,
-	INPUT_RECORD,
-	INPUT_PLAYCHAN,
-	INPUT_MSPROC,
-	INPUT_PHASE,
-	INPUT_GAIN,
-	INPUT_REFLEVEL,
-	INPUT_48V,
-	INPUT_AUTOSET,
-	INPUT_HIZ,
-	OUTPUT_VOLUME,
-	OUTPUT_PAN,
-	OUTPUT_MUTE,
-	OUTPUT_FXRETURN,
-	OUTPUT_STEREO,
-	OUTPUT_RECORD,
-	OUTPUT_PLAYCHAN,
-	OUTPUT_PHASE,
-	OUTPUT_REFLEVEL,
-	OUTPUT_CROSSFEED,
-	OUTPUT_VOLUMECAL,
-	LOWCUT,
-	LOWCUT_FREQ,
-	LOWCUT_SLOPE,
-	EQ,
-	EQ_BAND1TYPE,
-	EQ_BAND1GAIN,
-	EQ_BAND1FREQ,
-	EQ_BAND1Q,
-	EQ_BAND2GAIN,
-	EQ_BAND2FREQ,
-	EQ_BAND2Q,
-	EQ_BAND3TYPE,
-	EQ_BAND3GAIN,
-	EQ_BAND3FREQ,
-	EQ_BAND3Q,
-	DYNAMICS,
-	DYNAMICS_GAIN,
-	DYNAMICS_ATTACK,
-	DYNAMICS_RELEASE,
-	DYNAMICS_COMPTHRES,
-	DYNAMICS_COMPRATIO,
-	DYNAMICS_EXPTHRES,
-	DYNAMICS_EXPRATIO,
-	DYNAMICS_METER,
-	AUTOLEVEL,
-	AUTOLEVEL_MAXGAIN,
-	AUTOLEVEL_HEADROOM,
-	AUTOLEVEL_RISETIME,
-	AUTOLEVEL_METER,
-	ROOMEQ,
-	ROOMEQ_DELAY,
-	ROOMEQ_BAND1TYPE,
-	ROOMEQ_BAND1GAIN,
-	ROOMEQ_BAND1FREQ,
-	ROOMEQ_BAND1Q,
-	ROOMEQ_BAND2GAIN,
-	ROOMEQ_BAND2FREQ,
-	ROOMEQ_BAND2Q,
-	ROOMEQ_BAND3GAIN,
-	ROOMEQ_BAND3FREQ,
-	ROOMEQ_BAND3Q,
-	ROOMEQ_BAND4GAIN,
-	ROOMEQ_BAND4FREQ,
-	ROOMEQ_BAND4Q,
-	ROOMEQ_BAND5GAIN,
-	ROOMEQ_BAND5FREQ,
-	ROOMEQ_BAND5Q,
-	ROOMEQ_BAND6GAIN,
-	ROOMEQ_BAND6FREQ,
-	ROOMEQ_BAND6Q,
-	ROOMEQ_BAND7GAIN,
-	ROOMEQ_BAND7FREQ,
-	ROOMEQ_BAND7Q,
-	ROOMEQ_BAND8TYPE,
-	ROOMEQ_BAND8GAIN,
-	ROOMEQ_BAND8FREQ,
-	ROOMEQ_BAND8Q,
-	ROOMEQ_BAND9TYPE,
-	ROOMEQ_BAND9GAIN,
-	ROOMEQ_BAND9FREQ,
-	ROOMEQ_BAND9Q,
-	NAME,
-	MIX,
-	MIX_LEVEL,
-	REVERB,
-	REVERB_TYPE,
-	REVERB_PREDELAY,
-	REVERB_LOWCUT,
-	REVERB_ROOMSCALE,
-	REVERB_ATTACK,
-	REVERB_HOLD,
-	REVERB_RELEASE,
-	REVERB_HIGHCUT,
-	REVERB_TIME,
-	REVERB_HIGHDAMP,
-	REVERB_SMOOTH,
-	REVERB_VOLUME,
-	REVERB_WIDTH,
-	ECHO,
-	ECHO_TYPE,
-	ECHO_DELAY,
-	ECHO_FEEDBACK,
-	ECHO_HIGHCUT,
-	ECHO_VOLUME,
-	ECHO_WIDTH,
-	CTLROOM_MAINOUT,
-	CTLROOM_MAINMONO,
-	CTLROOM_MUTEENABLE,
-	CTLROOM_DIMREDUCTION,
-	CTLROOM_DIM,
-	CTLROOM_RECALLVOLUME,
-	CLOCK_SOURCE,
-	CLOCK_SAMPLERATE,
-	CLOCK_WCKOUT,
-	CLOCK_WCKSINGLE,
-	CLOCK_WCKTERM,
-	HARDWARE_OPTICALOUT,
-	HARDWARE_SPDIFOUT,
-	HARDWARE_CCMODE,
-	HARDWARE_CCMIX,
-	HARDWARE_STANDALONEMIDI,
-	HARDWARE_STANDALONEARC,
-	HARDWARE_LOCKKEYS,
-	HARDWARE_REMAPKEYS,
-	HARDWARE_DSPVERLOAD,
-	HARDWARE_DSPAVAIL,
-	HARDWARE_DSPSTATUS,
-	HARDWARE_ARCDELTA,
-	DUREC_STATUS,
-	DUREC_TIME,
-	DUREC_USBLOAD,
-	DUREC_TOTALSPACE,
-	DUREC_FREESPACE,
-	DUREC_NUMFILES,
-	DUREC_FILE,
-	DUREC_NEXT,
-	DUREC_RECORDTIME,
-	DUREC_INDEX,
-	DUREC_NAME0,
-	DUREC_NAME1,
-	DUREC_NAME2,
-	DUREC_NAME3,
-	DUREC_INFO,
-	DUREC_LENGTH,
-	DUREC_CONTROL,
-	DUREC_DELETE,
-	DUREC_SEEK,
-	DUREC_PLAYMODE,
-	REFRESH,
+/* every control, as X(name); expands to the enum and to name tables */
+#define CONTROLS(X) \
+	X(UNKNOWN) \
+	X(INPUT_MUTE) \
+	X(INPUT_FXSEND) \
+	X(INPUT_STEREO) \
+	X(INPUT_RECORD) \
+	X(INPUT_PLAYCHAN) \
+	X(INPUT_MSPROC) \
+	X(INPUT_PHASE) \
+	X(INPUT_GAIN) \
+	X(INPUT_REFLEVEL) \
+	X(INPUT_48V) \
+	X(INPUT_AUTOSET) \
+	X(INPUT_HIZ) \
+	X(OUTPUT_VOLUME) \
+	X(OUTPUT_PAN) \
+	X(OUTPUT_MUTE) \
+	X(OUTPUT_FXRETURN) \
+	X(OUTPUT_STEREO) \
+	X(OUTPUT_RECORD) \
+	X(OUTPUT_PLAYCHAN) \
+	X(OUTPUT_PHASE) \
+	X(OUTPUT_REFLEVEL) \
+	X(OUTPUT_CROSSFEED) \
+	X(OUTPUT_VOLUMECAL) \
+	X(LOWCUT) \
+	X(LOWCUT_FREQ) \
+	X(LOWCUT_SLOPE) \
+	X(EQ) \
+	X(EQ_BAND1TYPE) \
+	X(EQ_BAND1GAIN) \
+	X(EQ_BAND1FREQ) \
+	X(EQ_BAND1Q) \
+	X(EQ_BAND2GAIN) \
+	X(EQ_BAND2FREQ) \
+	X(EQ_BAND2Q) \
+	X(EQ_BAND3TYPE) \
+	X(EQ_BAND3GAIN) \
+	X(EQ_BAND3FREQ) \
+	X(EQ_BAND3Q) \
+	X(DYNAMICS) \
+	X(DYNAMICS_GAIN) \
+	X(DYNAMICS_ATTACK) \
+	X(DYNAMICS_RELEASE) \
+	X(DYNAMICS_COMPTHRES) \
+	X(DYNAMICS_COMPRATIO) \
+	X(DYNAMICS_EXPTHRES) \
+	X(DYNAMICS_EXPRATIO) \
+	X(DYNAMICS_METER) \
+	X(AUTOLEVEL) \
+	X(AUTOLEVEL_MAXGAIN) \
+	X(AUTOLEVEL_HEADROOM) \
+	X(AUTOLEVEL_RISETIME) \
+	X(AUTOLEVEL_METER) \
+	X(ROOMEQ) \
+	X(ROOMEQ_DELAY) \
+	X(ROOMEQ_BAND1TYPE) \
+	X(ROOMEQ_BAND1GAIN) \
+	X(ROOMEQ_BAND1FREQ) \
+	X(ROOMEQ_BAND1Q) \
+	X(ROOMEQ_BAND2GAIN) \
+	X(ROOMEQ_BAND2FREQ) \
+	X(ROOMEQ_BAND2Q) \
+	X(ROOMEQ_BAND3GAIN) \
+	X(ROOMEQ_BAND3FREQ) \
+	X(ROOMEQ_BAND3Q) \
+	X(ROOMEQ_BAND4GAIN) \
+	X(ROOMEQ_BAND4FREQ) \
+	X(ROOMEQ_BAND4Q) \
+	X(ROOMEQ_BAND5GAIN) \
+	X(ROOMEQ_BAND5FREQ) \
+	X(ROOMEQ_BAND5Q) \
+	X(ROOMEQ_BAND6GAIN) \
+	X(ROOMEQ_BAND6FREQ) \
+	X(ROOMEQ_BAND6Q) \
+	X(ROOMEQ_BAND7GAIN) \
+	X(ROOMEQ_BAND7FREQ) \
+	X(ROOMEQ_BAND7Q) \
+	X(ROOMEQ_BAND8TYPE) \
+	X(ROOMEQ_BAND8GAIN) \
+	X(ROOMEQ_BAND8FREQ) \
+	X(ROOMEQ_BAND8Q) \
+	X(ROOMEQ_BAND9TYPE) \
+	X(ROOMEQ_BAND9GAIN) \
+	X(ROOMEQ_BAND9FREQ) \
+	X(ROOMEQ_BAND9Q) \
+	X(NAME) \
+	X(MIX) \
+	X(MIX_LEVEL) \
+	X(REVERB) \
+	X(REVERB_TYPE) \
+	X(REVERB_PREDELAY) \
+	X(REVERB_LOWCUT) \
+	X(REVERB_ROOMSCALE) \
+	X(REVERB_ATTACK) \
+	X(REVERB_HOLD) \
+	X(REVERB_RELEASE) \
+	X(REVERB_HIGHCUT) \
+	X(REVERB_TIME) \
+	X(REVERB_HIGHDAMP) \
+	X(REVERB_SMOOTH) \
+	X(REVERB_VOLUME) \
+	X(REVERB_WIDTH) \
+	X(ECHO) \
+	X(ECHO_TYPE) \
+	X(ECHO_DELAY) \
+	X(ECHO_FEEDBACK) \
+	X(ECHO_HIGHCUT) \
+	X(ECHO_VOLUME) \
+	X(ECHO_WIDTH) \
+	X(CTLROOM_MAINOUT) \
+	X(CTLROOM_MAINMONO) \
+	X(CTLROOM_MUTEENABLE) \
+	X(CTLROOM_DIMREDUCTION) \
+	X(CTLROOM_DIM) \
+	X(CTLROOM_RECALLVOLUME) \
+	X(CLOCK_SOURCE) \
+	X(CLOCK_SAMPLERATE) \
+	X(CLOCK_WCKOUT) \
+	X(CLOCK_WCKSINGLE) \
+	X(CLOCK_WCKTERM) \
+	X(HARDWARE_OPTICALOUT) \
+	X(HARDWARE_SPDIFOUT) \
+	X(HARDWARE_CCMODE) \
+	X(HARDWARE_CCMIX) \
+	X(HARDWARE_STANDALONEMIDI) \
+	X(HARDWARE_STANDALONEARC) \
+	X(HARDWARE_LOCKKEYS) \
+	X(HARDWARE_REMAPKEYS) \
+	X(HARDWARE_DSPVERLOAD) \
+	X(HARDWARE_DSPAVAIL) \
+	X(HARDWARE_DSPSTATUS) \
+	X(HARDWARE_ARCDELTA) \
+	X(DUREC_STATUS) \
+	X(DUREC_TIME) \
+	X(DUREC_USBLOAD) \
+	X(DUREC_TOTALSPACE) \
+	X(DUREC_FREESPACE) \
+	X(DUREC_NUMFILES) \
+	X(DUREC_FILE) \
+	X(DUREC_NEXT) \
+	X(DUREC_RECORDTIME) \
+	X(DUREC_INDEX) \
+	X(DUREC_NAME0) \
+	X(DUREC_NAME1) \
+	X(DUREC_NAME2) \
+	X(DUREC_NAME3) \
+	X(DUREC_INFO) \
+	X(DUREC_LENGTH) \
+	X(DUREC_CONTROL) \
+	X(DUREC_DELETE) \
+	X(DUREC_SEEK) \
+	X(DUREC_PLAYMODE) \
+	X(REFRESH)
 
+enum control {
+#define X(name) name,
+	CONTROLS(X)
+#undef X
 	NUMCTLS
 };
 
@@ -194,6 +199,24 @@ struct param {
 	int out;
 };
 
+enum regflags {
+	REG_INPUT = 1 << 0,     /* one register per input */
+	REG_PLAYBACK = 1 << 1,  /* one register per playback channel */
+	REG_OUTPUT = 1 << 2,    /* one register per output, or row of mix registers */
+	REG_PAIR = 1 << 3,      /* one register per channel pair */
+	REG_RDONLY = 1 << 4,    /* only reported by the device */
+	REG_WRONLY = 1 << 5,    /* never reported by the device */
+	REG_COMMAND = 1 << 6,   /* triggers an action, so must not be written twice */
+};
+
+struct regmap {
+	enum control ctl;
+	int reg;        /* register of the first channel */
+	int stride;     /* distance between channels (between outputs for mix) */
+	int flags;
+	int chanflags;  /* channel must have these INPUT_HAS_* or OUTPUT_HAS_* flags */
+};
+
 struct device {
 	const char *id;
 	const char *name;
@@ -207,8 +230,12 @@ struct device {
 
 	int refresh;
 
-	int (*ctltoreg)(enum control ctl, const struct param *p);
-	enum control (*regtoctl)(int reg, struct param *p);
+	const struct regmap *regmap;
+	size_t regmaplen;
 };
 
+/* every supported device, in devices.c */
+extern const struct device *const devices[];
+extern const size_t deviceslen;
+
 #endif
@@ -0,0 +1,11 @@
+#include <stddef.h>
+#include "device.h"
+
+#define LEN(a) (sizeof (a) / sizeof *(a))
+
+extern const struct device ffucxii;
+
+const struct device *const devices[] = {
+	&ffucxii,
+};
+const size_t deviceslen = LEN(devices);
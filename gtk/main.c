@@ -1,5 +1,8 @@
 #include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
 #include <gtk/gtk.h>
+#include <gio/gunixsocketaddress.h>
 #include "channel.h"
 #include "mixer.h"
 #include "scaleentry.h"
@@ -55,6 +58,8 @@ struct _OSCMixWindow {
 	Mixer *osc;
 	gpointer send_host;
 	gpointer send_port;
+	/* the send address last connected to, as host!port */
+	char send_addr[288];
 	gpointer recv_host;
 	gpointer recv_port;
 
@@ -167,12 +172,41 @@ on_send_addr_changed(GtkEntry *entry, gpointer ptr)
 	GSocketAddressEnumerator *addrenum;
 
 	self = OSCMIX_WINDOW(ptr);
+	/* the spin button only updates its adjustment after this handler */
+	if (GTK_IS_SPIN_BUTTON(entry))
+		gtk_spin_button_update(GTK_SPIN_BUTTON(entry));
+	snprintf(self->send_addr, sizeof self->send_addr, "%s!%d", gtk_entry_get_text(self->send_host), (int)gtk_adjustment_get_value(self->send_port));
+	/* a path is the unix socket oscmix listens on */
+	if (gtk_entry_get_text(self->send_host)[0] == '/') {
+		GSocketAddress *unixaddr;
+
+		unixaddr = g_unix_socket_address_new(gtk_entry_get_text(self->send_host));
+		g_object_set(self->osc, "send-address", unixaddr, NULL);
+		mixer_send(self->osc, "/refresh", NULL);
+		return;
+	}
 	addr = g_network_address_new(gtk_entry_get_text(self->send_host), gtk_adjustment_get_value(self->send_port));
 	addrenum = g_socket_connectable_enumerate(addr);
 	g_socket_address_enumerator_next_async(addrenum, NULL, address_resolved, self);
 	g_object_unref(addr);
 }
 
+/* leaving the fields connects like activate, unless nothing was edited */
+static gboolean
+on_send_addr_focus_out(GtkWidget *widget, GdkEvent *event, gpointer ptr)
+{
+	OSCMixWindow *self;
+	char addr[sizeof self->send_addr];
+
+	self = OSCMIX_WINDOW(ptr);
+	if (GTK_IS_SPIN_BUTTON(widget))
+		gtk_spin_button_update(GTK_SPIN_BUTTON(widget));
+	snprintf(addr, sizeof addr, "%s!%d", gtk_entry_get_text(self->send_host), (int)gtk_adjustment_get_value(self->send_port));
+	if (strcmp(addr, self->send_addr) != 0)
+		on_send_addr_changed(GTK_ENTRY(widget), ptr);
+	return GDK_EVENT_PROPAGATE;
+}
+
 static void
 on_recv_addr_changed(GtkEntry *entry, gpointer ptr)
 {
@@ -476,6 +510,7 @@ oscmix_window_class_init(OSCMixWindowClass *class)
 	gtk_widget_class_bind_template_callback(GTK_WIDGET_CLASS(class), format_durec_position);
 	gtk_widget_class_bind_template_callback(GTK_WIDGET_CLASS(class), on_reverb_type_changed);
 	gtk_widget_class_bind_template_callback(GTK_WIDGET_CLASS(class), on_send_addr_changed);
+	gtk_widget_class_bind_template_callback(GTK_WIDGET_CLASS(class), on_send_addr_focus_out);
 	gtk_widget_class_bind_template_callback(GTK_WIDGET_CLASS(class), on_recv_addr_changed);
 	gtk_widget_class_bind_template_callback(GTK_WIDGET_CLASS(class), on_mainout_changed);
 	gtk_widget_class_bind_template_callback(GTK_WIDGET_CLASS(class), on_durec_stop);
@@ -12,6 +12,8 @@ struct _Mixer {
 	GSocketAddress *recv_address;
 	GHashTable *handlers;
 	GSource *source;
+	/* the socket is connected to send_address, and used for both directions */
+	bool connected;
 } _Mixer;
 
 typedef struct {
@@ -126,6 +128,12 @@ on_osc_data(GDatagramBased *socket, GIOCondition condition, gpointer ptr)
 
 	self = OSCMIX_MIXER(ptr);
 	ret = g_socket_receive(G_SOCKET(socket), (gchar *)buf, sizeof buf, NULL, NULL);
+	if (ret <= 0) {
+		if (!self->connected)
+			return true;
+		g_warning("connection to oscmix closed");
+		return false;
+	}
 	msg.err = NULL;
 	msg.buf = buf;
 	msg.end = buf + ret;
@@ -137,12 +145,42 @@ on_osc_data(GDatagramBased *socket, GIOCondition condition, gpointer ptr)
 static void
 setup_connection(Mixer *self)
 {
-	if (self->source)
+	GError *err;
+
+	if (self->source) {
+		if (!g_source_is_destroyed(self->source))
+			g_source_destroy(self->source);
 		g_source_unref(self->source);
-	if (self->socket)
+		self->source = NULL;
+	}
+	if (self->socket) {
 		g_object_unref(self->socket);
-	self->socket = g_socket_new(g_socket_address_get_family(self->recv_address), G_SOCKET_TYPE_DATAGRAM, G_SOCKET_PROTOCOL_UDP, NULL);
-	g_socket_bind(self->socket, self->recv_address, false, NULL);
+		self->socket = NULL;
+	}
+	err = NULL;
+	self->connected = self->send_address && g_socket_address_get_family(self->send_address) == G_SOCKET_FAMILY_UNIX;
+	if (self->connected) {
+		self->socket = g_socket_new(G_SOCKET_FAMILY_UNIX, G_SOCKET_TYPE_SEQPACKET, G_SOCKET_PROTOCOL_DEFAULT, &err);
+		if (self->socket && !g_socket_connect(self->socket, self->send_address, NULL, &err)) {
+			g_object_unref(self->socket);
+			self->socket = NULL;
+		}
+	} else if (self->recv_address) {
+		self->socket = g_socket_new(g_socket_address_get_family(self->recv_address), G_SOCKET_TYPE_DATAGRAM, G_SOCKET_PROTOCOL_UDP, &err);
+		/* without the receive address, messages can still be sent */
+		if (self->socket && !g_socket_bind(self->socket, self->recv_address, false, &err)) {
+			g_warning("%s", err->message);
+			g_clear_error(&err);
+		}
+	}
+	if (!self->socket) {
+		/* mixer_send drops messages until the next address change */
+		if (err) {
+			g_warning("%s", err->message);
+			g_error_free(err);
+		}
+		return;
+	}
 	self->source = g_socket_create_source(self->socket, G_IO_IN, NULL);
 	g_source_set_callback(self->source, (GSourceFunc)on_osc_data, self, NULL);
 	g_source_attach(self->source, NULL);
@@ -159,12 +197,16 @@ mixer_set_property(GObject *obj, guint id, const GValue *val, GParamSpec *spec)
 		if (self->send_address)
 			g_object_unref(self->send_address);
 		self->send_address = G_SOCKET_ADDRESS(g_value_get_object(val));
+		/* a unix socket replaces the receive socket with a connection */
+		if (self->connected || (self->send_address && g_socket_address_get_family(self->send_address) == G_SOCKET_FAMILY_UNIX))
+			setup_connection(self);
 		break;
 	case PROP_RECV_ADDRESS:
 		if (self->recv_address)
 			g_object_unref(self->recv_address);
 		self->recv_address = G_SOCKET_ADDRESS(g_value_get_object(val));
-		setup_connection(self);
+		if (!self->connected)
+			setup_connection(self);
 		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(obj, id, spec);
@@ -222,6 +264,7 @@ mixer_send(Mixer *self, const char *addr, GValue *val)
 	gssize ret;
 	GError *err;
 
+	/* not connected, such as when oscmix is not running */
 	if (!self->socket)
 		return;
 	msg.type = NULL;
@@ -255,9 +298,14 @@ mixer_send(Mixer *self, const char *addr, GValue *val)
 		oscputstr(&msg, ",");
 	}
 	err = NULL;
-	ret = g_socket_send_to(self->socket, self->send_address, (char *)buf, msg.buf - buf, NULL, &err);
-	if (ret < 0)
+	if (self->connected)
+		ret = g_socket_send(self->socket, (char *)buf, msg.buf - buf, NULL, &err);
+	else
+		ret = g_socket_send_to(self->socket, self->send_address, (char *)buf, msg.buf - buf, NULL, &err);
+	if (ret < 0 && err) {
 		g_warning("%s", err->message);
+		g_error_free(err);
+	}
 }
 
 static bool in_osc_to_prop;
@@ -0,0 +1,219 @@
+#define _GNU_SOURCE  /* for syscall */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#ifdef SYS_openat2
+#include <linux/openat2.h>
+#endif
+#include "httpfile.h"
+#include "util.h"
+
+#define LEN(a) (sizeof (a) / sizeof *(a))
+
+int httpfiledir = -1;
+
+static const struct {
+	const char *ext, *type;
+} types[] = {
+	{"css", "text/css"},
+	{"html", "text/html; charset=utf-8"},
+	{"ico", "image/x-icon"},
+	{"js", "text/javascript"},
+	{"json", "application/json"},
+	{"png", "image/png"},
+	{"svg", "image/svg+xml"},
+	{"wasm", "application/wasm"},
+};
+
+/* precompressed variants, in order of preference */
+static const struct {
+	const char *name, *suffix;
+} variants[] = {
+	{"br", ".br"},
+	{"gzip", ".gz"},
+};
+
+void
+httpfileroot(const char *dir)
+{
+	httpfiledir = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (httpfiledir < 0)
+		fatal("open %s:", dir);
+	/* unlike send, sendfile has no MSG_NOSIGNAL */
+	signal(SIGPIPE, SIG_IGN);
+}
+
+/* whether an Accept-Encoding list has the coding without q=0 */
+static bool
+accepts(const char *list, const char *coding)
+{
+	size_t len;
+
+	len = strlen(coding);
+	while (*list) {
+		list += strspn(list, " \t,");
+		if (strncasecmp(list, coding, len) == 0 && strchr(" \t;,", list[len])) {
+			list += len;
+			list += strspn(list, " \t");
+			if (*list != ';')
+				return true;
+			++list;
+			list += strspn(list, " \t");
+			if (strncmp(list, "q=0", 3) != 0)
+				return true;
+			list += 3;
+			list += strspn(list, ".0");
+			if (!strchr(" \t,", *list))
+				return true;
+		}
+		list += strcspn(list, ",");
+	}
+	return false;
+}
+
+/* whether an If-None-Match list has the entity tag */
+static bool
+matches(const char *list, const char *etag)
+{
+	size_t len;
+
+	len = strlen(etag);
+	while (*list) {
+		list += strspn(list, " \t,");
+		if (*list == '*')
+			return true;
+		/* the comparison is weak */
+		if (strncmp(list, "W/", 2) == 0)
+			list += 2;
+		if (strncmp(list, etag, len) == 0 && strchr(" \t,", list[len]))
+			return true;
+		list += strcspn(list, ",");
+	}
+	return false;
+}
+
+static int
+openfile(const char *name, struct stat *st)
+{
+#ifdef SYS_openat2
+	/* the kernel refuses any path, symlink included, that leads out of the root */
+	struct open_how how = {
+		.flags = O_RDONLY | O_NONBLOCK | O_CLOEXEC,
+		.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS,
+	};
+#endif
+	int fd;
+
+	fd = -1;
+	errno = ENOSYS;
+#ifdef SYS_openat2
+	fd = syscall(SYS_openat2, httpfiledir, name, &how, sizeof how);
+#endif
+	/* nonblocking, so a FIFO can't stall the server; only the checks
+	in httpfile keep the name beneath the root */
+	if (fd < 0 && errno == ENOSYS)
+		fd = openat(httpfiledir, name, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, st) != 0 || !S_ISREG(st->st_mode)) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* writes the header answering a GET of uri; returns its length, with the body in *fd, or -1 if there is no such file */
+int
+httpfile(char *uri, const char *encodings, const char *etags, char *buf, size_t len, int *fd, off_t *size)
+{
+	char name[256], variant[sizeof name + 4], etag[64], coding[32];
+	const char *type, *ext, *seg;
+	struct stat st, vst;
+	size_t i;
+	int ret, vfd;
+
+	uri[strcspn(uri, "?#")] = '\0';
+	if (httpfiledir < 0 || uri[0] != '/')
+		return -1;
+	/* this excludes . and .. as well as hidden files, and empty
+	segments, so the name can't start with '/' and be absolute */
+	for (seg = uri; seg; seg = strchr(seg + 1, '/')) {
+		if (seg[1] == '.' || seg[1] == '/')
+			return -1;
+	}
+	ret = snprintf(name, sizeof name, "%s%s", uri + 1, uri[strlen(uri) - 1] == '/' ? "index.html" : "");
+	if (ret < 0 || ret >= sizeof name)
+		return -1;
+	*fd = openfile(name, &st);
+	if (*fd < 0)
+		return -1;
+	type = "application/octet-stream";
+	ext = strrchr(name, '.');
+	if (ext && !strchr(ext, '/')) {
+		for (i = 0; i < LEN(types); ++i) {
+			if (strcmp(ext + 1, types[i].ext) == 0) {
+				type = types[i].type;
+				break;
+			}
+		}
+	}
+	coding[0] = '\0';
+	for (i = 0; i < LEN(variants) && encodings; ++i) {
+		if (!accepts(encodings, variants[i].name))
+			continue;
+		snprintf(variant, sizeof variant, "%s%s", name, variants[i].suffix);
+		vfd = openfile(variant, &vst);
+		if (vfd < 0)
+			continue;
+		/* a variant older than the file is stale */
+		if (vst.st_mtim.tv_sec < st.st_mtim.tv_sec || (vst.st_mtim.tv_sec == st.st_mtim.tv_sec && vst.st_mtim.tv_nsec < st.st_mtim.tv_nsec)) {
+			close(vfd);
+			continue;
+		}
+		close(*fd);
+		*fd = vfd;
+		st = vst;
+		snprintf(coding, sizeof coding, "Content-Encoding: %s\r\n", variants[i].name);
+		break;
+	}
+	snprintf(etag, sizeof etag, "\"%jx-%jx-%jx\"", (uintmax_t)st.st_ino, (uintmax_t)st.st_size,
+		(uintmax_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec);
+	if (etags && matches(etags, etag)) {
+		close(*fd);
+		*fd = -1;
+		*size = 0;
+		ret = snprintf(buf, len,
+			"HTTP/1.1 304 Not Modified\r\n"
+			"ETag: %s\r\n"
+			"Cache-Control: no-cache\r\n"
+			"Vary: Accept-Encoding\r\n"
+			"\r\n", etag);
+	} else {
+		*size = st.st_size;
+		ret = snprintf(buf, len,
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Type: %s\r\n"
+			"Content-Length: %jd\r\n"
+			"%s"
+			"ETag: %s\r\n"
+			"Cache-Control: no-cache\r\n"
+			"Vary: Accept-Encoding\r\n"
+			"\r\n", type, (intmax_t)st.st_size, coding, etag);
+	}
+	if (ret < 0 || ret >= len) {
+		if (*fd >= 0)
+			close(*fd);
+		return -1;
+	}
+	return ret;
+}
@@ -0,0 +1,16 @@
+#ifndef HTTPFILE_H
+#define HTTPFILE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* files this large or smaller are copied into the response instead of sent from the file */
+#define HTTPFILESMALL 16384
+
+/* directory of the served files, or -1 */
+extern int httpfiledir;
+
+void httpfileroot(const char *dir);
+int httpfile(char *uri, const char *encodings, const char *etags, char *buf, size_t len, int *fd, off_t *size);
+
+#endif
@@ -1,6 +1,7 @@
 #define _XOPEN_SOURCE 700  /* needed for SA_RESTART on FreeBSD */
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -9,62 +10,171 @@
 #include <string.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/time.h>
 #include <unistd.h>
 #include "oscmix.h"
 #include "arg.h"
+#include "httpfile.h"
+#include "mcast.h"
+#include "rawmidi.h"
+#include "record.h"
 #include "socket.h"
+#include "stats.h"
+#include "stream.h"
+#include "trace.h"
 #include "util.h"
+#include "ws.h"
+
+struct mididev {
+	int rfd, wfd;
+	struct mixer *mixer;
+	unsigned char rbuf[8192], *rbufend;
+	/* data that could not be written without blocking */
+	unsigned char *wbuf;
+	size_t wbuflen, wbufcap;
+	/* opened by the raw MIDI backend, and reopened after it goes away */
+	bool rawmidi;
+	bool lost;
+	char port[64];
+};
 
-extern int dflag;
 static int lflag;
 static int rfd, wfd;
+static int rframing, wframing;
+/* whether datagrams to wfd are sequenced for multicast receivers */
+static bool sequenced;
+/* clients accepted on rfd, and the connection to sendaddr */
+static struct stream **streams;
+static size_t streamslen, streamscap;
+static struct stream *sendstream;
+static struct mididev *devs;
+static size_t devslen;
+static int watchfd = -1;
 static volatile sig_atomic_t timeout;
+static volatile sig_atomic_t dumpstats;
 
 static void
 usage(void)
 {
-	fprintf(stderr, "usage: oscmix [-dlm] [-r addr] [-s addr]\n");
+	fprintf(stderr, "usage: oscmix [-dlm] [-f statefile] [-M meterfile] [-p port] [-r addr] [-s addr] [-S snapshotfile] [-t tracefile] [-w recfile] [-W webdir] [-z level[,minbytes]] [rfd,wfd[,port] | alsa[!port]]...\n");
 	exit(1);
 }
 
 static void
-midiread(int fd)
+devclose(struct mididev *dev)
+{
+	fprintf(stderr, "%s: disconnected\n", dev->port);
+	close(dev->rfd);
+	dev->rfd = -1;
+	dev->wfd = -1;
+	dev->wbuflen = 0;
+	dev->lost = true;
+}
+
+static void
+devreopen(struct mididev *dev)
+{
+	int fd;
+
+	fd = rawmidiopen(dev->port, NULL, dev->port, sizeof dev->port);
+	if (fd < 0)
+		return;
+	fprintf(stderr, "%s: reconnected\n", dev->port);
+	dev->rfd = fd;
+	dev->wfd = fd;
+	dev->rbufend = dev->rbuf;
+	recwrite(REC_CONNECT, dev - devs, &(unsigned char){1}, 1);
+	handleconnect(dev->mixer, true);
+}
+
+static void
+midiread(struct mididev *dev)
 {
-	static unsigned char data[8192], *dataend = data;
 	unsigned char *datapos, *nextpos;
-	uint_least32_t payload[sizeof data / 4];
+	uint_least32_t payload[sizeof dev->rbuf / 4];
+	uint_least64_t start;
 	ssize_t ret;
 
-	ret = read(fd, dataend, (data + sizeof data) - dataend);
-	if (ret < 0)
-		fatal("read %d:", fd);
-	dataend += ret;
-	datapos = data;
+	ret = read(dev->rfd, dev->rbufend, (dev->rbuf + sizeof dev->rbuf) - dev->rbufend);
+	if (ret <= 0 && dev->rawmidi) {
+		if (ret < 0 && errno == EAGAIN)
+			return;
+		devclose(dev);
+		return;
+	}
+	if (ret < 0) {
+		if (errno == EAGAIN)
+			return;
+		fatal("read %d:", dev->rfd);
+	}
+	dev->rbufend += ret;
+	datapos = dev->rbuf;
 	for (;;) {
-		assert(datapos <= dataend);
-		datapos = memchr(datapos, 0xf0, dataend - datapos);
+		assert(datapos <= dev->rbufend);
+		datapos = memchr(datapos, 0xf0, dev->rbufend - datapos);
 		if (!datapos) {
-			dataend = data;
+			dev->rbufend = dev->rbuf;
 			break;
 		}
-		nextpos = memchr(datapos + 1, 0xf7, dataend - datapos - 1);
+		nextpos = memchr(datapos + 1, 0xf7, dev->rbufend - datapos - 1);
 		if (!nextpos) {
-			if (dataend == data + sizeof data) {
+			if (datapos == dev->rbuf && dev->rbufend == dev->rbuf + sizeof dev->rbuf) {
 				fprintf(stderr, "sysex packet too large; dropping\n");
-				dataend = data;
+				statcount(STAT_SYSEXLARGE, sizeof dev->rbuf);
+				dev->rbufend = dev->rbuf;
+				recwrite(REC_LOST, dev - devs, NULL, 0);
+				handlelost(dev->mixer);
 			} else {
-				memmove(data, datapos, dataend - datapos);
-				dataend -= datapos - data;
+				memmove(dev->rbuf, datapos, dev->rbufend - datapos);
+				dev->rbufend -= datapos - dev->rbuf;
 			}
 			break;
 		}
 		++nextpos;
-		handlesysex(datapos, nextpos - datapos, payload);
+		recwrite(REC_MIDIIN, dev - devs, datapos, nextpos - datapos);
+		statcount(STAT_SYSEXIN, nextpos - datapos);
+		start = stattime();
+		handlesysex(dev->mixer, datapos, nextpos - datapos, payload);
+		stattimed(TIME_SYSEX, start);
 		datapos = nextpos;
 	}
 }
 
+static void
+midiflush(struct mididev *dev)
+{
+	ssize_t ret;
+
+	ret = write(dev->wfd, dev->wbuf, dev->wbuflen);
+	if (ret < 0) {
+		if (errno == EAGAIN)
+			return;
+		if (dev->rawmidi) {
+			devclose(dev);
+			return;
+		}
+		fatal("write %d:", dev->wfd);
+	}
+	dev->wbuflen -= ret;
+	memmove(dev->wbuf, dev->wbuf + ret, dev->wbuflen);
+}
+
+static void
+oscpacket(const unsigned char *buf, size_t len)
+{
+	uint_least64_t start;
+
+	recwrite(REC_OSCIN, 0, buf, len);
+	statcount(STAT_OSCIN, len);
+	if (sequenced && mcastnack(buf, len))
+		return;
+	start = stattime();
+	handleosc(buf, len);
+	stattimed(TIME_OSC, start);
+}
+
 static void
 oscread(int fd)
 {
@@ -76,32 +186,143 @@ oscread(int fd)
 		perror("recv");
 		return;
 	}
-	handleosc(buf, ret);
+	oscpacket(buf, ret);
+}
+
+static void
+addstream(int fd, int framing)
+{
+	struct stream **newstreams;
+	size_t cap;
+
+	if (streamslen == streamscap) {
+		cap = streamscap ? streamscap * 2 : 8;
+		newstreams = realloc(streams, cap * sizeof *streams);
+		if (!newstreams)
+			fatal("realloc:");
+		streams = newstreams;
+		streamscap = cap;
+	}
+	streams[streamslen++] = streamopen(fd, framing);
+}
+
+static void
+oscaccept(void)
+{
+	int fd, flags;
+
+	fd = accept(rfd, NULL, NULL);
+	if (fd < 0) {
+		if (errno != EAGAIN && errno != ECONNABORTED && errno != EINTR)
+			perror("accept");
+		return;
+	}
+	flags = fcntl(fd, F_GETFL);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+		perror("fcntl");
+		close(fd);
+		return;
+	}
+	if (!sockpeerok(fd)) {
+		fprintf(stderr, "rejecting connection from another user\n");
+		close(fd);
+		return;
+	}
+	if (rframing != FRAME_PACKET)
+		socknodelay(fd);
+	addstream(fd, rframing);
+}
+
+/* closes connections that hit EOF, an error, or overflowed */
+static void
+reapstreams(void)
+{
+	size_t i, j;
+
+	for (i = 0, j = 0; i < streamslen; ++i) {
+		if (!streams[i]->dead) {
+			streams[j++] = streams[i];
+			continue;
+		}
+		if (streams[i] == sendstream)
+			fatal("OSC connection closed");
+		streamclose(streams[i]);
+	}
+	streamslen = j;
 }
 
 void
-writemidi(const void *buf, size_t len)
+writemidi(void *arg, const void *buf, size_t len)
 {
+	struct mididev *dev;
 	const unsigned char *pos;
+	unsigned char *wbuf;
+	size_t cap;
 	ssize_t ret;
 
+	dev = arg;
+	recwrite(REC_MIDIOUT, dev - devs, buf, len);
+	if (dev->wfd == -1)
+		return;
+	statcount(STAT_SYSEXOUT, len);
 	pos = buf;
-	while (len > 0) {
-		ret = write(7, pos, len);
-		if (ret < 0)
-			fatal("write 7:");
+	if (dev->wbuflen == 0) {
+		ret = write(dev->wfd, pos, len);
+		if (ret < 0) {
+			if (errno != EAGAIN) {
+				if (dev->rawmidi) {
+					devclose(dev);
+					return;
+				}
+				fatal("write %d:", dev->wfd);
+			}
+			ret = 0;
+		}
 		pos += ret;
 		len -= ret;
+		if (len == 0)
+			return;
 	}
+	/* queue the rest until the device is writable again */
+	statcount(STAT_SYSEXQUEUED, len);
+	if (len > dev->wbufcap - dev->wbuflen) {
+		cap = dev->wbufcap ? dev->wbufcap * 2 : 8192;
+		while (cap - dev->wbuflen < len)
+			cap *= 2;
+		if (cap > 1 << 20) {
+			/* a stalled interface must not take the others down */
+			if (dev->rawmidi) {
+				fprintf(stderr, "%s: write queue overflow\n", dev->port);
+				devclose(dev);
+				return;
+			}
+			fatal("write %d: queue overflow", dev->wfd);
+		}
+		wbuf = realloc(dev->wbuf, cap);
+		if (!wbuf)
+			fatal("realloc:");
+		dev->wbuf = wbuf;
+		dev->wbufcap = cap;
+	}
+	memcpy(dev->wbuf + dev->wbuflen, pos, len);
+	dev->wbuflen += len;
 }
 
 void
 writeosc(const void *buf, size_t len)
 {
 	ssize_t ret;
+	size_t i;
 
-	ret = write(wfd, buf, len);
+	recwrite(REC_OSCOUT, 0, buf, len);
+	statcount(STAT_OSCOUT, len);
+	for (i = 0; i < streamslen; ++i)
+		streamwrite(streams[i], buf, len);
+	if (wframing != FRAME_NONE)
+		return;
+	ret = sequenced ? mcastwrite(buf, len) : write(wfd, buf, len);
 	if (ret < 0) {
+		statcount(STAT_OSCERROR, len);
 		if (errno != ECONNREFUSED)
 			perror("write");
 	} else if (ret != len) {
@@ -109,10 +330,115 @@ writeosc(const void *buf, size_t len)
 	}
 }
 
+static void
+opendev(struct mididev *dev, char *arg, const char *port)
+{
+	long val;
+	char *end;
+	int fd, flags;
+
+	dev->rbufend = dev->rbuf;
+	if (strncmp(arg, "alsa", 4) == 0 && (arg[4] == '\0' || arg[4] == '!')) {
+		port = arg[4] ? arg + 5 : NULL;
+		dev->rawmidi = true;
+		fd = rawmidiopen(port, supported, dev->port, sizeof dev->port);
+		if (fd < 0) {
+			if (!port)
+				fatal("no supported raw MIDI device found");
+			fprintf(stderr, "%s: not connected; waiting for device\n", port);
+			snprintf(dev->port, sizeof dev->port, "%s", port);
+		}
+		dev->rfd = fd;
+		dev->wfd = fd;
+		recwrite(REC_DEVICE, dev - devs, dev->port, strlen(dev->port));
+		dev->mixer = newmixer(dev->port, dev);
+		if (!dev->mixer)
+			exit(1);
+		if (fd < 0) {
+			recwrite(REC_CONNECT, dev - devs, &(unsigned char){0}, 1);
+			handleconnect(dev->mixer, false);
+		}
+		return;
+	}
+	val = strtol(arg, &end, 10);
+	if (end == arg || *end != ',' || val < 0 || val > INT_MAX)
+		usage();
+	dev->rfd = val;
+	arg = end + 1;
+	val = strtol(arg, &end, 10);
+	if (end == arg || (*end && *end != ',') || val < 0 || val > INT_MAX)
+		usage();
+	dev->wfd = val;
+	if (*end == ',')
+		port = end + 1;
+	if (!port)
+		fatal("device is not specified; pass -p or set MIDIPORT");
+	if (fcntl(dev->rfd, F_GETFD) < 0)
+		fatal("fcntl %d:", dev->rfd);
+	flags = fcntl(dev->wfd, F_GETFL);
+	if (flags < 0)
+		fatal("fcntl %d:", dev->wfd);
+	if (fcntl(dev->wfd, F_SETFL, flags | O_NONBLOCK) < 0)
+		fatal("fcntl %d:", dev->wfd);
+	snprintf(dev->port, sizeof dev->port, "%s", port);
+	recwrite(REC_DEVICE, dev - devs, port, strlen(port));
+	dev->mixer = newmixer(port, dev);
+	if (!dev->mixer)
+		exit(1);
+}
+
+/* maps size bytes of path, creating it if needed */
+static void *
+mapfile(const char *path, size_t size, int flags)
+{
+	int fd;
+	void *mem;
+
+	fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC | flags, 0644);
+	if (fd < 0)
+		fatal("open %s:", path);
+	if (ftruncate(fd, size) != 0)
+		fatal("ftruncate %s:", path);
+	mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mem == MAP_FAILED)
+		fatal("mmap %s:", path);
+	close(fd);
+	return mem;
+}
+
+/* with several devices, each gets its own file */
+static const char *
+devpath(const char *path, size_t i, char *buf, size_t len)
+{
+	if (devslen == 1)
+		return path;
+	snprintf(buf, len, "%s.%zu", path, i + 1);
+	return buf;
+}
+
+static void
+mapstate(struct mididev *dev, const char *path)
+{
+	if (loadstate(dev->mixer, mapfile(path, statesize(dev->mixer), 0)))
+		fprintf(stderr, "%s: restored state from %s\n", dev->port, path);
+}
+
+/* the trace lives in a shared mapping, so it is there to read even after a crash */
+static void
+maptrace(const char *path)
+{
+	enum { LEN = 1 << 16 };
+
+	traceinit(mapfile(path, tracesize(LEN), O_TRUNC), LEN);
+}
+
 static void
 sighandler(int sig)
 {
-	timeout = 1;
+	if (sig == SIGUSR1)
+		dumpstats = 1;
+	else
+		timeout = 1;
 }
 
 int
@@ -122,28 +448,40 @@ main(int argc, char *argv[])
 	static char defsendaddr[] = "udp!127.0.0.1!8222";
 	static char mcastaddr[] = "udp!224.0.0.1!8222";
 	static const unsigned char refreshosc[] = "/refresh\0\0\0\0,\0\0\0";
-	char *recvaddr, *sendaddr;
+	static char defdev[] = "6,7";
+	static char *defargv[] = {defdev, NULL};
+	char *recvaddr, *sendaddr, *statepath, *meterpath, *snappath, *recpath, *tracepath, path[PATH_MAX];
 	struct itimerval it;
 	struct sigaction sa;
-	struct pollfd pfd[2];
+	struct pollfd *pfd, *devpfd, *streampfd;
 	const char *port;
-
-	if (fcntl(6, F_GETFD) < 0)
-		fatal("fcntl 6:");
-	if (fcntl(7, F_GETFD) < 0)
-		fatal("fcntl 7:");
+	uint_least64_t start;
+	size_t i, n, pfdlen;
+	bool rawmidi;
+	int ticks;
 
 	recvaddr = defrecvaddr;
 	sendaddr = defsendaddr;
 	port = NULL;
+	statepath = NULL;
+	meterpath = NULL;
+	snappath = NULL;
+	recpath = NULL;
+	tracepath = NULL;
 
 	ARGBEGIN {
 	case 'd':
-		dflag = 1;
+		tracepath = "oscmix.trace";
+		break;
+	case 'f':
+		statepath = EARGF(usage());
 		break;
 	case 'l':
 		lflag = 1;
 		break;
+	case 'M':
+		meterpath = EARGF(usage());
+		break;
 	case 'r':
 		recvaddr = EARGF(usage());
 		break;
@@ -156,26 +494,71 @@ main(int argc, char *argv[])
 	case 'p':
 		port = EARGF(usage());
 		break;
+	case 'S':
+		snappath = EARGF(usage());
+		break;
+	case 't':
+		tracepath = EARGF(usage());
+		break;
+	case 'w':
+		recpath = EARGF(usage());
+		break;
+	case 'W':
+		httpfileroot(EARGF(usage()));
+		break;
+	case 'z':
+		wsdeflateinit(EARGF(usage()));
+		break;
 	default:
 		usage();
 		break;
 	} ARGEND
 
-	rfd = sockopen(recvaddr, 1);
-	wfd = sockopen(sendaddr, 0);
+	if (recpath && recopen(recpath) != 0)
+		fatal("open %s:", recpath);
+	if (tracepath)
+		maptrace(tracepath);
+	rfd = sockopen(recvaddr, 1, &rframing);
+	wfd = sockopen(sendaddr, 0, &wframing);
+	if (wframing != FRAME_NONE) {
+		addstream(wfd, wframing);
+		sendstream = streams[0];
+	} else if (sockmulticast(wfd)) {
+		mcastopen(wfd);
+		sequenced = true;
+	}
 
-	if (!port) {
+	if (!port)
 		port = getenv("MIDIPORT");
-		if (!port)
-			fatal("device is not specified; pass -p or set MIDIPORT");
+	if (argc == 0) {
+		argc = 1;
+		argv = defargv;
 	}
-	if (init(port) != 0)
-		return 1;
+	devslen = argc;
+	devs = calloc(devslen, sizeof *devs);
+	pfdlen = 2 + 2 * devslen;
+	pfd = calloc(pfdlen, sizeof *pfd);
+	if (!devs || !pfd)
+		fatal("calloc:");
+	rawmidi = false;
+	for (i = 0; i < devslen; ++i) {
+		opendev(&devs[i], argv[i], port);
+		rawmidi |= devs[i].rawmidi;
+		if (statepath)
+			mapstate(&devs[i], devpath(statepath, i, path, sizeof path));
+		if (meterpath)
+			setmeters(devs[i].mixer, mapfile(devpath(meterpath, i, path, sizeof path), metersize(devs[i].mixer), 0));
+		if (snappath)
+			setsnapshot(devs[i].mixer, mapfile(devpath(snappath, i, path, sizeof path), snapsize(devs[i].mixer), 0));
+	}
+	/* without hotplug notifications, the timer retries disconnected devices */
+	if (rawmidi)
+		watchfd = rawmidiwatch();
 
 	memset(&sa, 0, sizeof sa);
 	sa.sa_handler = sighandler;
 	sa.sa_flags = SA_RESTART;
-	if (sigaction(SIGALRM, &sa, NULL) != 0)
+	if (sigaction(SIGALRM, &sa, NULL) != 0 || sigaction(SIGUSR1, &sa, NULL) != 0)
 		fatal("sigaction:");
 	it.it_interval.tv_sec = 0;
 	it.it_interval.tv_usec = 100000;
@@ -183,21 +566,86 @@ main(int argc, char *argv[])
 	if (setitimer(ITIMER_REAL, &it, NULL) != 0)
 		fatal("setitimer:");
 
-	pfd[0].fd = 6;
-	pfd[0].events = POLLIN;
-	pfd[1].fd = rfd;
-	pfd[1].events = POLLIN;
+	recwrite(REC_OSCIN, 0, refreshosc, sizeof refreshosc - 1);
 	handleosc(refreshosc, sizeof refreshosc - 1);
+	ticks = 0;
 	for (;;) {
-		if (poll(pfd, 2, -1) < 0 && errno != EINTR)
+		reapstreams();
+		n = streamslen;
+		if (pfdlen < 2 + 2 * devslen + n) {
+			pfdlen = 2 + 2 * devslen + n * 2;
+			free(pfd);
+			pfd = calloc(pfdlen, sizeof *pfd);
+			if (!pfd)
+				fatal("calloc:");
+		}
+		pfd[0].fd = rfd;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = watchfd;
+		pfd[1].events = POLLIN;
+		devpfd = pfd + 2;
+		streampfd = devpfd + 2 * devslen;
+		/* only wait for writability when something is queued */
+		for (i = 0; i < devslen; ++i) {
+			devpfd[2 * i].fd = devs[i].rfd;
+			devpfd[2 * i].events = POLLIN;
+			devpfd[2 * i + 1].fd = devs[i].wbuflen > 0 ? devs[i].wfd : -1;
+			devpfd[2 * i + 1].events = POLLOUT;
+		}
+		/* stop reading from clients that are not keeping up with output */
+		for (i = 0; i < n; ++i) {
+			streampfd[i].fd = streams[i]->fd;
+			streampfd[i].events = 0;
+			if (streamqueued(streams[i]) < STREAMHIGH)
+				streampfd[i].events |= POLLIN;
+			if (streamqueued(streams[i]) > 0)
+				streampfd[i].events |= POLLOUT;
+		}
+		if (poll(pfd, 2 + 2 * devslen + n, -1) < 0 && errno != EINTR)
 			fatal("poll:");
-		if (pfd[0].revents & POLLIN)
-			midiread(6);
-		if (pfd[1].revents & POLLIN)
-			oscread(rfd);
+		for (i = 0; i < devslen; ++i) {
+			if (devpfd[2 * i].revents & (POLLIN | POLLHUP | POLLERR))
+				midiread(&devs[i]);
+			if (devs[i].wfd != -1 && devpfd[2 * i + 1].revents & POLLOUT)
+				midiflush(&devs[i]);
+			if (devs[i].lost) {
+				devs[i].lost = false;
+				recwrite(REC_CONNECT, i, &(unsigned char){0}, 1);
+				handleconnect(devs[i].mixer, false);
+			}
+		}
+		for (i = 0; i < n; ++i) {
+			if (streampfd[i].revents & (POLLIN | POLLHUP | POLLERR))
+				streamread(streams[i], oscpacket);
+			if (streampfd[i].revents & POLLOUT && !streams[i]->dead)
+				streamflush(streams[i]);
+		}
+		if (pfd[0].revents & POLLIN) {
+			if (rframing == FRAME_NONE)
+				oscread(rfd);
+			else
+				oscaccept();
+		}
 		if (timeout) {
 			timeout = 0;
+			recwrite(REC_TIMER, 0, &(unsigned char){lflag == 0}, 1);
+			start = stattime();
 			handletimer(lflag == 0);
+			stattimed(TIME_TIMER, start);
+			recflush();
+			if (rawmidi)
+				++ticks;
+		}
+		if (dumpstats) {
+			dumpstats = 0;
+			statdump(stderr);
+		}
+		if ((pfd[1].revents & POLLIN && rawmidichanged(watchfd)) || (rawmidi && ticks >= 10)) {
+			ticks = 0;
+			for (i = 0; i < devslen; ++i) {
+				if (devs[i].rawmidi && devs[i].rfd == -1)
+					devreopen(&devs[i]);
+			}
 		}
 	}
 }
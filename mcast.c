@@ -0,0 +1,258 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "intpack.h"
+#include "mcast.h"
+#include "osc.h"
+#include "record.h"
+#include "stats.h"
+#include "util.h"
+
+#define LEN(a) (sizeof (a) / sizeof *(a))
+
+/* distinct addresses whose latest message is kept */
+#define CACHELEN 8192
+/* bundles that can be repaired individually */
+#define HISTLEN 1024
+/* how long a repaired range is not repaired again, in ns */
+#define REPAIRHOLD 20000000
+
+struct entry {
+	unsigned short len;   /* 0 if unused */
+	unsigned short cap;
+	uint32_t mark;        /* the repair that last included it */
+	unsigned char *msg;
+};
+
+static int fd = -1;
+static uint32_t nextseq, repairs;
+/* the latest message sent to each address, found by open addressing */
+static struct entry *cache;
+static struct {
+	uint32_t seq;
+	bool all;  /* more messages than slots, so a repair sends every address */
+	unsigned char len;
+	unsigned short slots[32];
+} hist[HISTLEN];
+/* the latest repairs, so receivers that missed the same bundles cost one */
+static struct {
+	uint32_t first, last;
+	bool all;
+	uint_least64_t time;
+} recent[8];
+
+/* stamps every bundle written to fd with a sequence number from now on */
+void
+mcastopen(int sock)
+{
+	fd = sock;
+	cache = calloc(CACHELEN, sizeof *cache);
+	if (!cache)
+		fatal("calloc:");
+	/* nothing was sent yet, so any repair sends every address */
+	hist[0].seq = -1;
+}
+
+/* returns the cache slot for an address, or -1 if the cache is full */
+static long
+lookup(const char *addr)
+{
+	const unsigned char *pos;
+	uint32_t hash;
+	size_t i, n;
+
+	/* FNV-1a */
+	hash = 2166136261;
+	for (pos = (const unsigned char *)addr; *pos; ++pos)
+		hash = (hash ^ *pos) * 16777619;
+	for (i = hash % CACHELEN, n = 0; n < CACHELEN; i = (i + 1) % CACHELEN, ++n) {
+		if (cache[i].len == 0 || strcmp((char *)cache[i].msg, addr) == 0)
+			return i;
+	}
+	return -1;
+}
+
+/* records the messages of a bundle; levels are left out, since the next ones replace them */
+static void
+track(uint32_t seq, const unsigned char *buf, size_t len)
+{
+	const unsigned char *pos, *end;
+	const char *addr;
+	struct entry *e;
+	unsigned char *msg;
+	size_t n, addrlen;
+	long i;
+
+	hist[seq % HISTLEN].seq = seq;
+	hist[seq % HISTLEN].all = false;
+	hist[seq % HISTLEN].len = 0;
+	end = buf + len;
+	for (pos = buf + 16; end - pos >= 4; pos += 4 + n) {
+		n = getbe32(pos);
+		if (n > end - pos - 4)
+			break;
+		addr = (const char *)pos + 4;
+		addrlen = strnlen(addr, n);
+		if (addrlen == n || (addrlen >= 6 && memcmp(addr + addrlen - 6, "/level", 6) == 0))
+			continue;
+		i = lookup(addr);
+		if (i < 0)
+			continue;
+		e = &cache[i];
+		/* bundles are no larger than a repair bundle, so any message fits in one */
+		if (n > e->cap) {
+			msg = realloc(e->msg, n);
+			if (!msg)
+				fatal("realloc:");
+			e->msg = msg;
+			e->cap = n;
+		}
+		memcpy(e->msg, addr, n);
+		e->len = n;
+		if (hist[seq % HISTLEN].len == LEN(hist[0].slots))
+			hist[seq % HISTLEN].all = true;
+		else
+			hist[seq % HISTLEN].slots[hist[seq % HISTLEN].len++] = i;
+	}
+}
+
+/* writes a bundle with a /seq message first; returns the bytes of buf written */
+ssize_t
+mcastwrite(const void *buf, size_t len)
+{
+	unsigned char seq[20] = "\0\0\0\x10/seq\0\0\0\0,i\0\0";
+	struct iovec iov[3];
+	ssize_t ret;
+
+	if (len < 16 || memcmp(buf, "#bundle", 8) != 0)
+		return write(fd, buf, len);
+	putbe32(seq + 16, nextseq);
+	track(nextseq, buf, len);
+	++nextseq;
+	iov[0].iov_base = (void *)buf;
+	iov[0].iov_len = 16;
+	iov[1].iov_base = seq;
+	iov[1].iov_len = sizeof seq;
+	iov[2].iov_base = (unsigned char *)buf + 16;
+	iov[2].iov_len = len - 16;
+	ret = writev(fd, iov, LEN(iov));
+	return ret < 0 ? ret : ret - (ssize_t)sizeof seq;
+}
+
+/* repairs are output like any other bundle, for the recorder and statistics */
+static void
+repairflush(unsigned char *buf, unsigned char *pos)
+{
+	ssize_t ret;
+
+	recwrite(REC_OSCREPAIR, 0, buf, pos - buf);
+	statcount(STAT_OSCOUT, pos - buf);
+	statcount(STAT_OSCREPAIR, pos - buf);
+	ret = mcastwrite(buf, pos - buf);
+	if (ret < 0) {
+		statcount(STAT_OSCERROR, pos - buf);
+		perror("write");
+	}
+}
+
+/* whether a recent repair already resent the latest messages of the range */
+static bool
+repaired(uint32_t first, uint32_t last, uint_least64_t now)
+{
+	size_t i;
+
+	for (i = 0; i < LEN(recent); ++i) {
+		if (now - recent[i].time >= REPAIRHOLD)
+			continue;
+		if ((recent[i].all || first - recent[i].first < 0x80000000) && recent[i].last - last < 0x80000000)
+			return true;
+	}
+	return false;
+}
+
+/* sends the latest message to every address in the bundles from first to last */
+static void
+repair(uint32_t first, uint32_t last)
+{
+	static unsigned char buf[8192];
+	unsigned char *pos;
+	uint_least64_t now;
+	uint32_t seq;
+	bool all;
+	size_t i;
+
+	/* bundles not sent yet can't be missing */
+	if (last - first >= 0x80000000 || first - nextseq < 0x80000000)
+		return;
+	if (last - nextseq < 0x80000000)
+		last = nextseq - 1;
+	now = stattime();
+	if (repaired(first, last, now))
+		return;
+	/* a range longer than the history is resent whole, without walking it */
+	all = nextseq - first > HISTLEN || last - first >= HISTLEN;
+	i = repairs++ % LEN(recent);
+	recent[i].first = first;
+	recent[i].last = last;
+	recent[i].all = all;
+	recent[i].time = now;
+	for (seq = first; !all && seq != last + 1; ++seq) {
+		if (hist[seq % HISTLEN].seq != seq || hist[seq % HISTLEN].all) {
+			all = true;
+			break;
+		}
+		for (i = 0; i < hist[seq % HISTLEN].len; ++i)
+			cache[hist[seq % HISTLEN].slots[i]].mark = repairs;
+	}
+	memcpy(buf, "#bundle\0\0\0\0\0\0\0\0\1", 16);
+	pos = buf + 16;
+	for (i = 0; i < CACHELEN; ++i) {
+		if (cache[i].len == 0 || (!all && cache[i].mark != repairs))
+			continue;
+		if (4 + cache[i].len > buf + sizeof buf - pos) {
+			repairflush(buf, pos);
+			pos = buf + 16;
+		}
+		pos = putbe32(pos, cache[i].len);
+		memcpy(pos, cache[i].msg, cache[i].len);
+		pos += cache[i].len;
+	}
+	if (pos > buf + 16)
+		repairflush(buf, pos);
+}
+
+/* handles a /nack message for bundles a receiver missed; returns whether it was one */
+bool
+mcastnack(const unsigned char *buf, size_t len)
+{
+	struct oscmsg msg;
+	uint32_t first, last;
+
+	if (fd < 0 || len < 8 || memcmp(buf, "/nack\0\0\0", 8) != 0)
+		return false;
+	statcount(STAT_OSCNACK, len);
+	first = last = 0;
+	msg.err = NULL;
+	msg.buf = (unsigned char *)buf + 8;
+	msg.end = (unsigned char *)buf + len;
+	msg.type = "s";
+	msg.type = oscgetstr(&msg);
+	if (!msg.err && msg.type[0] != ',')
+		msg.err = "invalid osc types";
+	if (!msg.err) {
+		++msg.type;
+		first = oscgetint(&msg);
+		last = *msg.type ? oscgetint(&msg) : first;
+	}
+	if (oscend(&msg) != 0) {
+		fprintf(stderr, "/nack: %s\n", msg.err);
+		return true;
+	}
+	repair(first, last);
+	return true;
+}
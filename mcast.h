@@ -0,0 +1,12 @@
+#ifndef MCAST_H
+#define MCAST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+void mcastopen(int fd);
+ssize_t mcastwrite(const void *buf, size_t len);
+bool mcastnack(const unsigned char *buf, size_t len);
+
+#endif
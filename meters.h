@@ -0,0 +1,48 @@
+#ifndef METERS_H
+#define METERS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define METERMAGIC "OSCMIXLV"
+#define METERVERSION 1
+
+struct meter {
+	float peak, rms;      /* dBFS */
+	float peakfx, rmsfx;  /* after FX; inputs and outputs only */
+	uint32_t clip;
+};
+
+/* followed by the meters of the inputs, then playbacks, then outputs */
+struct meterhdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t inputslen;
+	uint32_t outputslen;  /* also the number of playbacks */
+	char device[32];
+	_Atomic uint32_t seq;  /* odd while a frame is being written */
+	uint64_t frame;        /* level packets published so far */
+};
+
+/* copies the first len meters of one frame, and returns its number */
+static inline uint64_t
+meterread(const struct meterhdr *hdr, struct meter *meters, size_t len)
+{
+	uint32_t seq;
+	uint64_t frame;
+
+	for (;;) {
+		seq = atomic_load_explicit((_Atomic uint32_t *)&hdr->seq, memory_order_acquire);
+		if (seq & 1)
+			continue;
+		memcpy(meters, hdr + 1, len * sizeof *meters);
+		frame = hdr->frame;
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit((_Atomic uint32_t *)&hdr->seq, memory_order_relaxed) == seq)
+			return frame;
+	}
+}
+
+#endif
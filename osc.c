@@ -158,6 +158,24 @@ oscputint(struct oscmsg *msg, int_least32_t val)
 	msg->buf = pos + 4;
 }
 
+void
+oscputint64(struct oscmsg *msg, int_least64_t val)
+{
+	unsigned char *pos;
+
+	if (msg->type) {
+		assert(*msg->type == 'h');
+		++msg->type;
+	}
+	pos = msg->buf;
+	if (msg->end - pos < 8) {
+		msg->err = "buffer too small";
+		return;
+	}
+	putbe64(pos, val);
+	msg->buf = pos + 8;
+}
+
 void
 oscputfloat(struct oscmsg *msg, float val)
 {
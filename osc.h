@@ -17,6 +17,7 @@ float oscgetfloat(struct oscmsg *msg);
 
 void oscputstr(struct oscmsg *msg, const char *str);
 void oscputint(struct oscmsg *msg, int_least32_t val);
+void oscputint64(struct oscmsg *msg, int_least64_t val);
 void oscputfloat(struct oscmsg *msg, float val);
 
 bool oscmatch(const char *pat, const char *str, char **end);
@@ -11,9 +11,13 @@
 #include <strings.h>  /* for strcasecmp */
 #include "device.h"
 #include "intpack.h"
+#include "meters.h"
 #include "oscmix.h"
 #include "osc.h"
+#include "snapshot.h"
+#include "stats.h"
 #include "sysex.h"
+#include "trace.h"
 #include "util.h"
 
 #define LEN(a) (sizeof (a) / sizeof *(a))
@@ -24,6 +28,7 @@ struct context {
 	const char *pattern;
 	char *addr, *addrpos, *addrend;
 	struct param param;
+	struct gang *gang;
 	bool exact;
 };
 
@@ -50,13 +55,47 @@ struct input {
 	bool stereo;
 	bool mute;
 	int width;
+	int gain;
 };
 
 struct output {
 	bool stereo;
+	int volume;
 	float *mix;
 };
 
+struct gangmember {
+	enum control ctl;  /* MIX, OUTPUT_VOLUME, or INPUT_GAIN */
+	struct param param;
+};
+
+struct gang {
+	struct gangmember members[64];
+	size_t memberslen;
+};
+
+/* registers written between two serial writes */
+struct serialwindow {
+	struct {
+		short first, last;
+	} ranges[16];
+	size_t rangeslen;
+	bool overflow;
+	/* serial was written, but not yet echoed */
+	bool pending;
+};
+
+enum {
+	HIST_BEGIN = 1 << 0,   /* first change of a transaction */
+};
+
+struct histentry {
+	unsigned long time;  /* in timer ticks */
+	short reg;
+	unsigned char flags;
+	int32_t old, new;
+};
+
 struct durecfile {
 	short reg[6];
 	char name[9];
@@ -65,34 +104,139 @@ struct durecfile {
 	unsigned length;
 };
 
-int dflag;
-static const struct device *device;
-static struct input *inputs;
-static struct output *outputs;
-static struct {
-	int status;
-	int position;
-	int time;
-	int usberrors;
-	int usbload;
-	float totalspace;
-	float freespace;
-	struct durecfile *files;
-	size_t fileslen;
-	int file;
-	int recordtime;
-	int index;
-	int next;
-	int playmode;
-} durec = {.index = -1};
-static struct {
-	int vers;
-	int load;
-} dsp;
+/* state of one interface */
+struct mixer {
+	int id;
+	void *arg;  /* passed to writemidi */
+	const struct device *device;
+	struct input *inputs;
+	struct output *outputs;
+	/* FX peak and RMS of inputs followed by outputs, from the last level packets */
+	uint_least32_t *peakfxs;
+	uint_least64_t *rmsfxs;
+	struct {
+		int status;
+		int position;
+		int time;
+		int usberrors;
+		int usbload;
+		float totalspace;
+		float freespace;
+		struct durecfile *files;
+		size_t fileslen;
+		int file;
+		int recordtime;
+		int index;
+		int next;
+		int playmode;
+	} durec;
+	struct {
+		int vers;
+		int load;
+	} dsp;
+	struct gang gangs[8];
+	/* maps register to control and channel */
+	struct {
+		short ctl;
+		signed char in, out;
+		unsigned char flags;  /* REG_RDONLY or REG_COMMAND */
+	} *regctl;
+	/* maps control and channel slot to register */
+	short *ctlreg;
+	short ctlstride[NUMCTLS];
+	int ctlslots;
+	/* register writes waiting to be sent in a single sysex */
+	uint_least32_t regqueue[128];
+	size_t regqueuelen;
+	int serial;
+	/* last serial echoed by the device, or -1 if none was yet */
+	int serialack;
+	struct serialwindow windows[16];
+	struct {
+		unsigned long lost;     /* serial windows that were never echoed */
+		unsigned long resent;   /* register ranges written again */
+		unsigned long refreshes;
+	} link;
+	bool connected;
+	/* last known register values, or -1 if unknown; see imageslot */
+	int32_t *regimage;
+	/* timer ticks left during which unchanged registers are not reported */
+	int resync;
+	/* persistent copy of the state, if any, and whether its derived state is out of date */
+	struct statehdr *state;
+	bool statedirty;
+	/* shared level meters, if any */
+	struct meterhdr *meters;
+	/* published state, if any, and whether it is out of date */
+	struct snaphdr *snap;
+	bool snapdirty;
+	/* ring of register changes; the first pos of len are applied */
+	struct {
+		struct histentry entries[2048];
+		size_t first, len, pos;
+		bool begin;     /* the next change starts a transaction */
+		bool applying;  /* undoing or redoing, so nothing is recorded */
+		bool reporting; /* handling a device report, so nothing is recorded */
+	} history;
+	unsigned long ticks;
+};
+
+/* layout of the state file: header, register image, then derived state */
+struct statehdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t size;
+	char device[32];
+	uint32_t inputslen;
+	uint32_t outputslen;
+	uint32_t fileslen;
+	/* incremented every time the derived state is saved */
+	uint32_t generation;
+	uint32_t regsum;
+	uint32_t derivedsum;
+};
+
+struct stateinput {
+	int32_t stereo;
+	int32_t mute;
+	int32_t width;
+	int32_t gain;
+};
+
+struct stateoutput {
+	int32_t stereo;
+	int32_t volume;
+};
+
+struct statefile {
+	char name[12];
+	uint32_t samplerate;
+	uint32_t channels;
+	uint32_t length;
+};
+
+/* registers, followed by the pan values of mix registers */
+#define IMAGELEN 0x10000
+
+#define STATEVERSION 1
+/* DURec files beyond this are not persisted */
+#define STATEFILES 512
+
+static struct mixer **mixers;
+static size_t mixerslen;
+/* the mixer currently being handled */
+static struct mixer *mixer;
+/* timer ticks between pushes of the statistics, or 0 */
+static unsigned long statsperiod;
+static unsigned long statsticks;
 
 static void oscsend(const char *addr, const char *type, ...);
 static void oscflush(void);
 static void oscsendenum(const char *addr, int val, const char *const names[], size_t nameslen);
+static void oscsendstrs(const char *addr, const char *const strs[], size_t len);
+static void savestate(void);
+static void publishsnap(void);
+static void setstats(struct oscmsg *msg);
 
 static void
 dump(const char *name, const void *ptr, size_t len)
@@ -113,12 +257,42 @@ dump(const char *name, const void *ptr, size_t len)
 	putchar('\n');
 }
 
+static void
+flushregs(void)
+{
+	struct sysex sysex;
+	unsigned char sysexbuf[7 + LEN(mixer->regqueue) * 5], *pos;
+	size_t i, sysexlen;
+
+	if (mixer->regqueuelen == 0)
+		return;
+	if (!mixer->connected) {
+		mixer->regqueuelen = 0;
+		return;
+	}
+	sysex.mfrid = 0x200d;
+	sysex.devid = 0x10;
+	sysex.data = NULL;
+	sysex.datalen = mixer->regqueuelen * 5;
+	sysex.subid = 0;
+	sysexlen = sysexenc(&sysex, sysexbuf, SYSEX_MFRID | SYSEX_DEVID | SYSEX_SUBID);
+	pos = sysex.data;
+	for (i = 0; i < mixer->regqueuelen; ++i)
+		pos = putle32_7bit(pos, mixer->regqueue[i]);
+	mixer->regqueuelen = 0;
+	writemidi(mixer->arg, sysexbuf, sysexlen);
+}
+
 static void
 writesysex(int subid, const unsigned char *buf, size_t len, unsigned char *sysexbuf)
 {
 	struct sysex sysex;
 	size_t sysexlen;
 
+	/* keep ordering with any queued register writes */
+	flushregs();
+	if (!mixer->connected)
+		return;
 	sysex.mfrid = 0x200d;
 	sysex.devid = 0x10;
 	sysex.data = NULL;
@@ -126,19 +300,103 @@ writesysex(int subid, const unsigned char *buf, size_t len, unsigned char *sysex
 	sysex.subid = subid;
 	sysexlen = sysexenc(&sysex, sysexbuf, SYSEX_MFRID | SYSEX_DEVID | SYSEX_SUBID);
 	base128enc(sysex.data, buf, len);
-	writemidi(sysexbuf, sysexlen);
+	writemidi(mixer->arg, sysexbuf, sysexlen);
+}
+
+/* mix registers hold either a volume or a pan, so pans are kept separately */
+static int
+imageslot(int reg, int val)
+{
+	if (val & 0x8000 && mixer->regctl[reg].ctl == MIX)
+		return reg | 0x8000;
+	return reg;
+}
+
+/* updates the register image, keeping the state file checksum current */
+static void
+setimage(int reg, int32_t val)
+{
+	reg = imageslot(reg, val);
+	/* the serial changes every tick, and is of no use to readers */
+	if (reg != 0x3F00 && mixer->regimage[reg] != val) {
+		mixer->snapdirty = true;
+		mixer->statedirty = true;
+	}
+	if (mixer->state)
+		mixer->state->regsum += (uint32_t)(reg + 1) * ((uint32_t)val - (uint32_t)mixer->regimage[reg]);
+	mixer->regimage[reg] = val;
+}
+
+/* remembers that reg was written in the current serial window */
+static void
+trackreg(int reg)
+{
+	struct serialwindow *w;
+	size_t i;
+
+	w = &mixer->windows[mixer->serial];
+	if (w->overflow)
+		return;
+	for (i = w->rangeslen; i-- > 0;) {
+		if (reg >= w->ranges[i].first - 1 && reg <= w->ranges[i].last + 1) {
+			if (reg < w->ranges[i].first)
+				w->ranges[i].first = reg;
+			else if (reg > w->ranges[i].last)
+				w->ranges[i].last = reg;
+			return;
+		}
+	}
+	if (w->rangeslen == LEN(w->ranges)) {
+		w->overflow = true;
+		return;
+	}
+	w->ranges[w->rangeslen].first = reg;
+	w->ranges[w->rangeslen].last = reg;
+	++w->rangeslen;
+}
+
+static struct histentry *
+histentry(size_t i)
+{
+	return &mixer->history.entries[(mixer->history.first + i) % LEN(mixer->history.entries)];
+}
+
+/* records a write made for a client; changes reported by the device, and writes derived from them, are not undone */
+static void
+record(int reg, int32_t old, int32_t new)
+{
+	struct histentry *e;
+
+	if (mixer->history.applying || mixer->history.reporting || old == -1 || old == new)
+		return;
+	/* a new change discards anything that could have been redone */
+	mixer->history.len = mixer->history.pos;
+	if (mixer->history.len == LEN(mixer->history.entries)) {
+		mixer->history.first = (mixer->history.first + 1) % LEN(mixer->history.entries);
+		--mixer->history.len;
+		histentry(0)->flags |= HIST_BEGIN;
+	}
+	e = histentry(mixer->history.len++);
+	e->time = mixer->ticks;
+	e->reg = reg;
+	e->flags = 0;
+	e->old = old;
+	e->new = new;
+	if (mixer->history.begin) {
+		e->flags |= HIST_BEGIN;
+		mixer->history.begin = false;
+	}
+	mixer->history.pos = mixer->history.len;
 }
 
 static int
 setreg(unsigned reg, unsigned val)
 {
 	unsigned long regval;
-	unsigned char buf[4], sysexbuf[7 + 5];
 	unsigned par;
 
 	val &= 0xffff;
-	if (dflag && reg != 0x3f00)
-		fprintf(stderr, "setreg %.4X %.4X\n", reg, val);
+	trace(TRACE_SETREG, mixer->id, reg, val);
 	regval = (reg & 0x7fff) << 16 | val;
 	par = regval >> 16 ^ regval;
 	par ^= par >> 8;
@@ -146,18 +404,68 @@ setreg(unsigned reg, unsigned val)
 	par ^= par >> 2;
 	par ^= par >> 1;
 	regval |= (~par & 1) << 31;
-	putle32(buf, regval);
 
-	writesysex(0, buf, sizeof buf, sysexbuf);
+	reg &= 0x7fff;
+	if (reg != 0x3F00 && ~mixer->regctl[reg].flags & REG_COMMAND)
+		record(reg, mixer->regimage[imageslot(reg, val)], val);
+	setimage(reg, val);
+	if (reg != 0x3F00)
+		trackreg(reg);
+	if (mixer->regqueuelen == LEN(mixer->regqueue))
+		flushregs();
+	mixer->regqueue[mixer->regqueuelen++] = regval;
+	return 0;
+}
+
+static int
+ctlslot(const struct param *p)
+{
+	if (p->in != -1) {
+		if ((unsigned)p->in >= mixer->device->inputslen + mixer->device->outputslen)
+			return -1;
+		return 1 + p->in;
+	}
+	if (p->out != -1) {
+		if ((unsigned)p->out >= mixer->device->outputslen)
+			return -1;
+		return 1 + mixer->device->inputslen + mixer->device->outputslen + p->out;
+	}
 	return 0;
 }
 
+static int
+ctltoreg(enum control ctl, const struct param *p)
+{
+	int slot, reg;
+
+	slot = ctlslot(p);
+	if (slot == -1)
+		return -1;
+	reg = mixer->ctlreg[ctl * mixer->ctlslots + slot];
+	if (reg != -1 && mixer->ctlstride[ctl] != 0) {
+		if ((unsigned)p->out >= mixer->device->outputslen)
+			return -1;
+		reg += p->out * mixer->ctlstride[ctl];
+	}
+	return reg;
+}
+
+static enum control
+regtoctl(int reg, struct param *p)
+{
+	if ((unsigned)reg >= 0x8000)
+		return -1;
+	p->in = mixer->regctl[reg].in;
+	p->out = mixer->regctl[reg].out;
+	return mixer->regctl[reg].ctl;
+}
+
 static void
 setval(struct context *ctx, int val)
 {
 	int reg;
 
-	reg = device->ctltoreg(ctx->node->ctl, &ctx->param);
+	reg = ctltoreg(ctx->node->ctl, &ctx->param);
 	if (reg != -1)
 		setreg(reg, val);
 }
@@ -256,9 +564,9 @@ setmixlevel(const struct input *in, const struct output *out, float level)
 	long val;
 	struct param p;
 
-	p.in = in - inputs;
-	p.out = out - outputs;
-	reg = device->ctltoreg(MIX_LEVEL, &p);
+	p.in = in - mixer->inputs;
+	p.out = out - mixer->outputs;
+	reg = ctltoreg(MIX_LEVEL, &p);
 	if (reg == -1)
 		return;
 	val = lroundf(level * 0x8000);
@@ -269,6 +577,20 @@ setmixlevel(const struct input *in, const struct output *out, float level)
 	setreg(reg, val);
 }
 
+/* a muted input's mix levels are 0 on the device; knowing that lets the first write to them be undone */
+static void
+seedmixlevel(const struct input *in, const struct output *out)
+{
+	int reg;
+	struct param p;
+
+	p.in = in - mixer->inputs;
+	p.out = out - mixer->outputs;
+	reg = ctltoreg(MIX_LEVEL, &p);
+	if (reg != -1 && mixer->regimage[reg] == -1)
+		setimage(reg, 0);
+}
+
 static void
 setchannel(struct context *ctx, struct oscmsg *msg)
 {
@@ -280,15 +602,15 @@ setchannel(struct context *ctx, struct oscmsg *msg)
 		return;
 	--index;
 	if (strcmp(ctx->node->name, "input") == 0) {
-		if (index >= device->inputslen + device->outputslen)
+		if (index >= mixer->device->inputslen + mixer->device->outputslen)
 			return;
 		ctx->param.in = index;
 	} else if (strcmp(ctx->node->name, "playback") == 0) {
-		if (index >= device->outputslen)
+		if (index >= mixer->device->outputslen)
 			return;
-		ctx->param.in = device->inputslen + index;
+		ctx->param.in = mixer->device->inputslen + index;
 	} else if (strcmp(ctx->node->name, "output") == 0) {
-		if (index >= device->outputslen)
+		if (index >= mixer->device->outputslen)
 			return;
 		ctx->param.out = index;
 	} else {
@@ -324,13 +646,13 @@ muteinput(struct input *in, bool mute)
 
 	if (in->mute == mute)
 		return;
-	if (in->stereo && (in - inputs) & 1)
+	if (in->stereo && (in - mixer->inputs) & 1)
 		--in;
 	in[0].mute = mute;
 	if (in->stereo)
 		in[1].mute = mute;
-	for (out = outputs; out != outputs + device->outputslen; ++out) {
-		mix = &out->mix[in - inputs];
+	for (out = mixer->outputs; out != mixer->outputs + mixer->device->outputslen; ++out) {
+		mix = &out->mix[in - mixer->inputs];
 		if (mix[0] > 0)
 			setmixlevel(in, out, mute ? 0 : mix[0]);
 		if (in->stereo && mix[1] > 0)
@@ -347,8 +669,8 @@ setinputmute(struct context *ctx, struct oscmsg *msg)
 	val = oscgetint(msg);
 	if (oscend(msg) != 0)
 		return;
-	assert((unsigned)ctx->param.in < device->inputslen + device->outputslen);
-	in = &inputs[ctx->param.in];
+	assert((unsigned)ctx->param.in < mixer->device->inputslen + mixer->device->outputslen);
+	in = &mixer->inputs[ctx->param.in];
 	setval(ctx, val);
 	muteinput(in, val);
 }
@@ -358,8 +680,8 @@ newinputmute(struct context *ctx, int val)
 {
 	struct input *in;
 
-	assert((unsigned)ctx->param.in < device->inputslen);
-	in = &inputs[ctx->param.in];
+	assert((unsigned)ctx->param.in < mixer->device->inputslen);
+	in = &mixer->inputs[ctx->param.in];
 	muteinput(in, val);
 	newbool(ctx, val);
 }
@@ -373,7 +695,7 @@ setinputstereo(struct context *ctx, struct oscmsg *msg)
 	val = oscgetint(msg);
 	if (oscend(msg) != 0)
 		return;
-	in = &inputs[ctx->param.in & ~1];
+	in = &mixer->inputs[ctx->param.in & ~1];
 	in[0].stereo = in[1].stereo = val;
 	setval(ctx, val);
 	ctx->param.in ^= 1;
@@ -385,13 +707,13 @@ newinputstereo(struct context *ctx, int val)
 {
 	struct input *in;
 
-	assert((unsigned)ctx->param.in < device->inputslen);
-	in = &inputs[ctx->param.in & ~1];
+	assert((unsigned)ctx->param.in < mixer->device->inputslen);
+	in = &mixer->inputs[ctx->param.in & ~1];
 	in[0].stereo = val;
 	in[1].stereo = val;
-	snprintf(ctx->addr, ctx->addrend - ctx->addr, "/input/%d/stereo", (int)(in - inputs) + 1);
+	snprintf(ctx->addr, ctx->addrend - ctx->addr, "/input/%d/stereo", (int)(in - mixer->inputs) + 1);
 	oscsend(ctx->addr, ",i", val != 0);
-	snprintf(ctx->addr, ctx->addrend - ctx->addr, "/input/%d/stereo", (int)(in - inputs) + 2);
+	snprintf(ctx->addr, ctx->addrend - ctx->addr, "/input/%d/stereo", (int)(in - mixer->inputs) + 2);
 	oscsend(ctx->addr, ",i", val != 0);
 }
 
@@ -400,13 +722,13 @@ newoutputstereo(struct context *ctx, int val)
 {
 	struct output *out;
 
-	assert((unsigned)ctx->param.out < device->outputslen);
-	out = &outputs[ctx->param.out & ~1];
+	assert((unsigned)ctx->param.out < mixer->device->outputslen);
+	out = &mixer->outputs[ctx->param.out & ~1];
 	out[0].stereo = val;
 	out[1].stereo = val;
-	snprintf(ctx->addr, ctx->addrend - ctx->addr, "/output/%d/stereo", (int)(out - outputs + 1));
+	snprintf(ctx->addr, ctx->addrend - ctx->addr, "/output/%d/stereo", (int)(out - mixer->outputs + 1));
 	oscsend(ctx->addr, ",i", val != 0);
-	snprintf(ctx->addr, ctx->addrend - ctx->addr, "/output/%d/stereo", (int)(out - outputs + 2));
+	snprintf(ctx->addr, ctx->addrend - ctx->addr, "/output/%d/stereo", (int)(out - mixer->outputs + 2));
 	oscsend(ctx->addr, ",i", val != 0);
 }
 
@@ -420,7 +742,7 @@ setname(struct context *ctx, struct oscmsg *msg)
 	name = oscgetstr(msg);
 	if (oscend(msg) != 0)
 		return;
-	reg = device->ctltoreg(ctx->node->ctl, &ctx->param);
+	reg = ctltoreg(ctx->node->ctl, &ctx->param);
 	if (reg == -1)
 		return;
 	strncpy(namebuf, name, sizeof namebuf - 1);
@@ -440,8 +762,8 @@ setinputgain(struct context *ctx, struct oscmsg *msg)
 	val = oscgetfloat(msg);
 	if (oscend(msg) != 0)
 		return;
-	assert((unsigned)ctx->param.in < device->inputslen);
-	info = &device->inputs[ctx->param.in];
+	assert((unsigned)ctx->param.in < mixer->device->inputslen);
+	info = &mixer->device->inputs[ctx->param.in];
 	if (info->flags & INPUT_HAS_GAIN) {
 		if (val < info->gain.min)
 			val = info->gain.min;
@@ -454,16 +776,26 @@ setinputgain(struct context *ctx, struct oscmsg *msg)
 static void
 newinputgain(struct context *ctx, int val)
 {
+	assert((unsigned)ctx->param.in < mixer->device->inputslen);
+	mixer->inputs[ctx->param.in].gain = val;
 	oscsend(ctx->addr, ",f", val / 10.0);
 }
 
+static void
+newoutputvolume(struct context *ctx, int val)
+{
+	assert((unsigned)ctx->param.out < mixer->device->outputslen);
+	mixer->outputs[ctx->param.out].volume = val;
+	newfixed(ctx, val);
+}
+
 static void
 newinputreflevel(struct context *ctx, int val)
 {
 	const struct channelinfo *info;
 
-	assert((unsigned)ctx->param.in < device->inputslen);
-	info = &device->inputs[ctx->param.in];
+	assert((unsigned)ctx->param.in < mixer->device->inputslen);
+	info = &mixer->device->inputs[ctx->param.in];
 	oscsendenum(ctx->addr, val & 0xf, info->reflevel.names, info->reflevel.nameslen);
 }
 
@@ -496,13 +828,13 @@ seteqdrecord(struct context *ctx, struct oscmsg *msg)
 static void
 newdspload(struct context *ctx, int val)
 {
-	if (dsp.load != (val & 0xff)) {
-		dsp.load = val & 0xff;
-		oscsend("/hardware/dspload", ",i", dsp.load);
+	if (mixer->dsp.load != (val & 0xff)) {
+		mixer->dsp.load = val & 0xff;
+		oscsend("/hardware/dspload", ",i", mixer->dsp.load);
 	}
-	if (dsp.vers != val >> 8) {
-		dsp.vers = val >> 8;
-		oscsend("/hardware/dspvers", ",i", dsp.vers);
+	if (mixer->dsp.vers != val >> 8) {
+		mixer->dsp.vers = val >> 8;
+		oscsend("/hardware/dspvers", ",i", mixer->dsp.vers);
 	}
 }
 
@@ -527,9 +859,9 @@ setdb(const struct output *out, const struct input *in, float db)
 	int reg, val;
 	struct param p;
 
-	p.in = in - inputs;
-	p.out = out - outputs;
-	reg = device->ctltoreg(MIX, &p);
+	p.in = in - mixer->inputs;
+	p.out = out - mixer->outputs;
+	reg = ctltoreg(MIX, &p);
 	if (reg == -1)
 		return;
 	val = (isinf(db) && db < 0 ? -650 : lroundf(db * 10.f)) & 0x7fff;
@@ -542,9 +874,9 @@ setpan(const struct output *out, const struct input *in, int pan)
 	int reg, val;
 	struct param p;
 
-	p.in = in - inputs;
-	p.out = out - outputs;
-	reg = device->ctltoreg(MIX, &p);
+	p.in = in - mixer->inputs;
+	p.out = out - mixer->outputs;
+	reg = ctltoreg(MIX, &p);
 	if (reg == -1)
 		return;
 	val = (pan & 0x7fff) | 0x8000;
@@ -565,11 +897,11 @@ calclevel(const struct output *out, const struct input *in, bool instereo, struc
 
 	if (instereo)
 		instereo = in->stereo;
-	if (instereo && (in - inputs) & 1)
+	if (instereo && (in - mixer->inputs) & 1)
 		--in;
-	if (out->stereo && (out - outputs) & 1)
+	if (out->stereo && (out - mixer->outputs) & 1)
 		--out;
-	ich = in - inputs;
+	ich = in - mixer->inputs;
 	if (out->stereo) {
 		ll = out[0].mix[ich];
 		lr = out[1].mix[ich];
@@ -614,15 +946,17 @@ setlevel(struct output *out, const struct input *in, bool instereo, const struct
 	float ll, lr, rl, rr;
 	float *mix[2];
 
+	/* the mix of a muted input changes without a register write */
+	mixer->statedirty = true;
 	if (instereo)
 		instereo = in->stereo;
-	if (instereo && (in - inputs) & 1)
+	if (instereo && (in - mixer->inputs) & 1)
 		--in;
-	if (out->stereo && (out - outputs) & 1)
+	if (out->stereo && (out - mixer->outputs) & 1)
 		--out;
-	mix[0] = &out[0].mix[in - inputs];
+	mix[0] = &out[0].mix[in - mixer->inputs];
 	if (out->stereo) {
-		mix[1] = &out[1].mix[in - inputs];
+		mix[1] = &out[1].mix[in - mixer->inputs];
 		if (instereo) {
 			w = l->width / 100.f;
 			if (l->pan > 0) {
@@ -641,6 +975,9 @@ setlevel(struct output *out, const struct input *in, bool instereo, const struct
 			if (!in->mute) {
 				setmixlevel(in + 1, out, rl);
 				setmixlevel(in + 1, out + 1, rr);
+			} else {
+				seedmixlevel(in + 1, out);
+				seedmixlevel(in + 1, out + 1);
 			}
 		} else {
 			theta = (l->pan + 100) * PI / 400.f;
@@ -652,6 +989,9 @@ setlevel(struct output *out, const struct input *in, bool instereo, const struct
 		if (!in->mute) {
 			setmixlevel(in, out, ll);
 			setmixlevel(in, out + 1, lr);
+		} else {
+			seedmixlevel(in, out);
+			seedmixlevel(in, out + 1);
 		}
 	} else {
 		if (instereo) {
@@ -665,12 +1005,32 @@ setlevel(struct output *out, const struct input *in, bool instereo, const struct
 			mix[0][1] = rl;
 			if (!in->mute)
 				setmixlevel(in + 1, out, rl);
+			else
+				seedmixlevel(in + 1, out);
 		} else {
 			ll = l->vol;
 		}
 		mix[0][0] = ll;
 		if (!in->mute)
 			setmixlevel(in, out, ll);
+		else
+			seedmixlevel(in, out);
+	}
+}
+
+static void
+updatemix(struct output *out, struct input *in, const struct level *level)
+{
+	struct level l;
+
+	setlevel(out, in, 1, level);
+	calclevel(out, in, 0, &l);
+	setdb(out, in, 20.f * log10f(l.vol));
+	setpan(out, in, l.pan);
+	if (in->stereo) {
+		calclevel(out, in + 1, 0, &l);
+		setdb(out, in + 1, 20.f * log10f(l.vol));
+		setpan(out, in + 1, l.pan);
 	}
 }
 
@@ -686,29 +1046,29 @@ setmix(struct context *ctx, struct oscmsg *msg)
 	int base;
 
 	i = strtoul(ctx->pattern + 1, &end, 10) - 1;
-	if (*end != '/' || i >= device->outputslen)
+	if (*end != '/' || i >= mixer->device->outputslen)
 		return;
 	ctx->param.out = i;
 	ctx->pattern = end;
-	out = &outputs[i];
+	out = &mixer->outputs[i];
 
 	if (oscmatch(ctx->pattern, "input", &end))
 		base = 0;
 	else if (oscmatch(ctx->pattern, "playback", &end))
-		base = device->inputslen;
+		base = mixer->device->inputslen;
 	else
 		return;
 	i = strtoul(end + 1, &end, 10) - 1;
-	if (*end || i >= device->inputslen + device->outputslen - base)
+	if (*end || i >= mixer->device->inputslen + mixer->device->outputslen - base)
 		return;
 	i += base;
 	ctx->param.in = i;
 	ctx->pattern = end;
-	in = &inputs[i];
+	in = &mixer->inputs[i];
 
-	if (out->stereo && (out - outputs) & 1)
+	if (out->stereo && (out - mixer->outputs) & 1)
 		--out;
-	if (in->stereo && (in - inputs) & 1)
+	if (in->stereo && (in - mixer->inputs) & 1)
 		--in;
 
 	calclevel(out, in, 1, &level);
@@ -729,15 +1089,7 @@ setmix(struct context *ctx, struct oscmsg *msg)
 	}
 	if (oscend(msg) != 0)
 		return;
-	setlevel(out, in, 1, &level);
-	calclevel(out, in, 0, &level);
-	setdb(out, in, 20.f * log10f(level.vol));
-	setpan(out, in, level.pan);
-	if (in->stereo) {
-		calclevel(out, in + 1, 0, &level);
-		setdb(out, in + 1, 20.f * log10f(level.vol));
-		setpan(out, in + 1, level.pan);
-	}
+	updatemix(out, in, &level);
 }
 
 static void
@@ -748,13 +1100,13 @@ newmix(struct context *ctx, int val)
 	bool ispan;
 	struct level level;
 
-	if (ctx->param.out >= device->outputslen || ctx->param.in >= device->inputslen)
+	if (ctx->param.out >= mixer->device->outputslen || ctx->param.in >= mixer->device->inputslen)
 		return;
 	assert(ctx->param.in >= 0);
 	assert(ctx->param.out >= 0);
-	in = &inputs[ctx->param.in];
-	out = &outputs[ctx->param.out];
-	if ((out - outputs) & 1 && out->stereo)
+	in = &mixer->inputs[ctx->param.in];
+	out = &mixer->outputs[ctx->param.out];
+	if ((out - mixer->outputs) & 1 && out->stereo)
 		return;
 	ispan = val & 0x8000;
 	val = ((val & 0x7fff) ^ 0x4000) - 0x4000;
@@ -772,15 +1124,301 @@ newmix(struct context *ctx, int val)
 	}
 	setlevel(out, in, 0, &level);
 	if (in->stereo) {
-		if ((in - inputs) & 1)
+		if ((in - mixer->inputs) & 1)
 			--in;
 		calclevel(out, in, 1, &level);
 		in->width = level.width;
 	}
-	snprintf(ctx->addr, ctx->addrend - ctx->addr, "/mix/%d/input/%d", (int)(out - outputs) + 1, (int)(in - inputs) + 1);
+	snprintf(ctx->addr, ctx->addrend - ctx->addr, "/mix/%d/input/%d", (int)(out - mixer->outputs) + 1, (int)(in - mixer->inputs) + 1);
 	oscsend(ctx->addr, ",fi", level.vol > 0 ? 20.f * log10f(level.vol) : -INFINITY, level.pan);
 }
 
+static long
+parseindex(const char *str, char **end, long max)
+{
+	long i;
+
+	if (*str != '/')
+		return -1;
+	i = strtol(str + 1, end, 10);
+	return i >= 1 && i <= max ? i - 1 : -1;
+}
+
+static int
+parsegangmember(const char *addr, struct gangmember *m)
+{
+	char *end;
+	long i;
+
+	m->param.in = m->param.out = -1;
+	if (oscmatch(addr, "mix", &end)) {
+		m->ctl = MIX;
+		m->param.out = parseindex(end, &end, mixer->device->outputslen);
+		if (m->param.out == -1)
+			return -1;
+		if (oscmatch(end, "input", &end)) {
+			i = parseindex(end, &end, mixer->device->inputslen);
+		} else if (oscmatch(end, "playback", &end)) {
+			i = parseindex(end, &end, mixer->device->outputslen);
+			if (i != -1)
+				i += mixer->device->inputslen;
+		} else {
+			return -1;
+		}
+		if (i == -1 || *end)
+			return -1;
+		m->param.in = i;
+	} else if (oscmatch(addr, "output", &end)) {
+		m->ctl = OUTPUT_VOLUME;
+		m->param.out = parseindex(end, &end, mixer->device->outputslen);
+		if (m->param.out == -1 || !oscmatch(end, "volume", &end) || *end)
+			return -1;
+	} else if (oscmatch(addr, "input", &end)) {
+		m->ctl = INPUT_GAIN;
+		m->param.in = parseindex(end, &end, mixer->device->inputslen);
+		if (m->param.in == -1 || !oscmatch(end, "gain", &end) || *end)
+			return -1;
+		if (~mixer->device->inputs[m->param.in].flags & INPUT_HAS_GAIN)
+			return -1;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+/* sends the addresses of the members of a gang */
+static void
+sendgang(const struct gang *g)
+{
+	char addr[32], names[LEN(g->members)][48];
+	const char *strs[LEN(g->members)];
+	const struct gangmember *m;
+	size_t i;
+
+	for (i = 0; i < g->memberslen; ++i) {
+		m = &g->members[i];
+		switch (m->ctl) {
+		case MIX:
+			if (m->param.in < mixer->device->inputslen)
+				snprintf(names[i], sizeof names[i], "/mix/%d/input/%d", m->param.out + 1, m->param.in + 1);
+			else
+				snprintf(names[i], sizeof names[i], "/mix/%d/playback/%d", m->param.out + 1, m->param.in - (int)mixer->device->inputslen + 1);
+			break;
+		case OUTPUT_VOLUME:
+			snprintf(names[i], sizeof names[i], "/output/%d/volume", m->param.out + 1);
+			break;
+		case INPUT_GAIN:
+			snprintf(names[i], sizeof names[i], "/input/%d/gain", m->param.in + 1);
+			break;
+		default:
+			assert(0);
+		}
+		strs[i] = names[i];
+	}
+	snprintf(addr, sizeof addr, "/gang/%d/members", (int)(g - mixer->gangs) + 1);
+	oscsendstrs(addr, strs, g->memberslen);
+	oscflush();
+}
+
+static void
+setgang(struct context *ctx, struct oscmsg *msg)
+{
+	char *end;
+	long i;
+
+	i = parseindex(ctx->pattern, &end, LEN(mixer->gangs));
+	if (i == -1 || *end != '/')
+		return;
+	ctx->gang = &mixer->gangs[i];
+	ctx->pattern = end;
+}
+
+static void
+setgangadd(struct context *ctx, struct oscmsg *msg)
+{
+	struct gang *g;
+	struct gangmember m;
+	const char *addr;
+	size_t i;
+
+	g = ctx->gang;
+	while (*msg->type) {
+		addr = oscgetstr(msg);
+		if (!addr)
+			return;
+		if (parsegangmember(addr, &m) != 0) {
+			fprintf(stderr, "invalid gang member '%s'\n", addr);
+			continue;
+		}
+		for (i = 0; i < g->memberslen; ++i) {
+			if (g->members[i].ctl == m.ctl && g->members[i].param.in == m.param.in && g->members[i].param.out == m.param.out)
+				break;
+		}
+		if (i < g->memberslen)
+			continue;
+		if (g->memberslen == LEN(g->members)) {
+			msg->err = "too many gang members";
+			break;
+		}
+		g->members[g->memberslen++] = m;
+	}
+	if (!msg->err)
+		oscend(msg);
+	sendgang(g);
+}
+
+static void
+setgangremove(struct context *ctx, struct oscmsg *msg)
+{
+	struct gang *g;
+	struct gangmember m;
+	const char *addr;
+	size_t i;
+
+	g = ctx->gang;
+	while (*msg->type) {
+		addr = oscgetstr(msg);
+		if (!addr)
+			return;
+		if (parsegangmember(addr, &m) != 0)
+			continue;
+		for (i = 0; i < g->memberslen; ++i) {
+			if (g->members[i].ctl == m.ctl && g->members[i].param.in == m.param.in && g->members[i].param.out == m.param.out) {
+				g->members[i] = g->members[--g->memberslen];
+				break;
+			}
+		}
+	}
+	oscend(msg);
+	sendgang(g);
+}
+
+static void
+setgangclear(struct context *ctx, struct oscmsg *msg)
+{
+	if (oscend(msg) != 0)
+		return;
+	ctx->gang->memberslen = 0;
+	sendgang(ctx->gang);
+}
+
+/* computes all targets before writing any, so no member sees another's new value */
+static void
+applygang(struct gang *g, float db, bool relative)
+{
+	float cur[LEN(g->members)], min[LEN(g->members)], max[LEN(g->members)];
+	float val[LEN(g->members)];
+	struct gangmember members[LEN(g->members)];
+	const struct gangmember *m;
+	const struct channelinfo *info;
+	struct output *out;
+	struct input *in;
+	struct level level;
+	size_t i, j, n;
+	int reg;
+
+	/* a mix is set through the left channels of its stereo pairs, so both channels are one member */
+	n = 0;
+	for (i = 0; i < g->memberslen; ++i) {
+		members[n] = g->members[i];
+		if (members[n].ctl == MIX) {
+			if (mixer->outputs[members[n].param.out].stereo)
+				members[n].param.out &= ~1;
+			if (mixer->inputs[members[n].param.in].stereo)
+				members[n].param.in &= ~1;
+		}
+		for (j = 0; j < n; ++j) {
+			if (members[j].ctl == members[n].ctl && members[j].param.in == members[n].param.in && members[j].param.out == members[n].param.out)
+				break;
+		}
+		if (j == n)
+			++n;
+	}
+	for (i = 0; i < n; ++i) {
+		m = &members[i];
+		switch (m->ctl) {
+		case MIX:
+			out = &mixer->outputs[m->param.out];
+			in = &mixer->inputs[m->param.in];
+			calclevel(out, in, 1, &level);
+			cur[i] = level.vol > 0 ? 20.f * log10f(level.vol) : -INFINITY;
+			min[i] = -65.f;
+			max[i] = 6.f;
+			break;
+		case OUTPUT_VOLUME:
+			cur[i] = mixer->outputs[m->param.out].volume / 10.f;
+			min[i] = -65.f;
+			max[i] = 6.f;
+			break;
+		case INPUT_GAIN:
+			info = &mixer->device->inputs[m->param.in];
+			cur[i] = mixer->inputs[m->param.in].gain / 10.f;
+			min[i] = info->gain.min / 10.f;
+			max[i] = info->gain.max / 10.f;
+			break;
+		default:
+			assert(0);
+		}
+	}
+	for (i = 0; i < n; ++i) {
+		val[i] = relative ? cur[i] + db : db;
+		val[i] = val[i] < min[i] ? min[i] : val[i] > max[i] ? max[i] : val[i];
+	}
+	for (i = 0; i < n; ++i) {
+		m = &members[i];
+		if (val[i] == cur[i] || (val[i] <= min[i] && cur[i] <= min[i]))
+			continue;
+		switch (m->ctl) {
+		case MIX:
+			out = &mixer->outputs[m->param.out];
+			in = &mixer->inputs[m->param.in];
+			calclevel(out, in, 1, &level);
+			level.width = in->width;
+			level.vol = val[i] <= -65.f ? 0 : powf(10.f, val[i] / 20.f);
+			updatemix(out, in, &level);
+			break;
+		case OUTPUT_VOLUME:
+			reg = ctltoreg(OUTPUT_VOLUME, &m->param);
+			if (reg == -1)
+				break;
+			mixer->outputs[m->param.out].volume = lroundf(val[i] * 10);
+			setreg(reg, mixer->outputs[m->param.out].volume);
+			break;
+		case INPUT_GAIN:
+			reg = ctltoreg(INPUT_GAIN, &m->param);
+			if (reg == -1)
+				break;
+			mixer->inputs[m->param.in].gain = lroundf(val[i] * 10);
+			setreg(reg, mixer->inputs[m->param.in].gain);
+			break;
+		default:
+			assert(0);
+		}
+	}
+}
+
+static void
+setgangoffset(struct context *ctx, struct oscmsg *msg)
+{
+	float db;
+
+	db = oscgetfloat(msg);
+	if (oscend(msg) != 0)
+		return;
+	applygang(ctx->gang, db, true);
+}
+
+static void
+setgangvalue(struct context *ctx, struct oscmsg *msg)
+{
+	float db;
+
+	db = oscgetfloat(msg);
+	if (oscend(msg) != 0)
+		return;
+	applygang(ctx->gang, db, false);
+}
+
 static long
 getsamplerate(int val)
 {
@@ -840,13 +1478,13 @@ newdurecstatus(struct context *ctx, int val)
 	int position;
 
 	status = val & 0xF;
-	if (status != durec.status) {
-		durec.status = status;
+	if (status != mixer->durec.status) {
+		mixer->durec.status = status;
 		oscsendenum("/durec/status", status, names, LEN(names));
 	}
 	position = (val >> 8) * 100 / 65;
-	if (position != durec.position) {
-		durec.position = position;
+	if (position != mixer->durec.position) {
+		mixer->durec.position = position;
 		oscsend("/durec/position", ",i", position);
 	}
 }
@@ -854,8 +1492,8 @@ newdurecstatus(struct context *ctx, int val)
 static void
 newdurectime(struct context *ctx, int val)
 {
-	if (val != durec.time) {
-		durec.time = val;
+	if (val != mixer->durec.time) {
+		mixer->durec.time = val;
 		oscsend("/durec/time", ",i", val);
 	}
 }
@@ -866,13 +1504,13 @@ newdurecusbstatus(struct context *ctx, int val)
 	int usbload, usberrors;
 
 	usbload = val >> 8;
-	if (usbload != durec.usbload) {
-		durec.usbload = usbload;
+	if (usbload != mixer->durec.usbload) {
+		mixer->durec.usbload = usbload;
 		oscsend("/durec/usbload", ",i", val >> 8);
 	}
 	usberrors = val & 0xff;
-	if (usberrors != durec.usberrors) {
-		durec.usberrors = usberrors;
+	if (usberrors != mixer->durec.usberrors) {
+		mixer->durec.usberrors = usberrors;
 		oscsend("/durec/usberrors", ",i", val & 0xff);
 	}
 }
@@ -883,8 +1521,8 @@ newdurectotalspace(struct context *ctx, int val)
 	float totalspace;
 
 	totalspace = val / 16.f;
-	if (totalspace != durec.totalspace) {
-		durec.totalspace = totalspace;
+	if (totalspace != mixer->durec.totalspace) {
+		mixer->durec.totalspace = totalspace;
 		oscsend("/durec/totalspace", ",f", totalspace);
 	}
 }
@@ -895,8 +1533,8 @@ newdurecfreespace(struct context *ctx, int val)
 	float freespace;
 
 	freespace = val / 16.f;
-	if (freespace != durec.freespace) {
-		durec.freespace = freespace;
+	if (freespace != mixer->durec.freespace) {
+		mixer->durec.freespace = freespace;
 		oscsend("/durec/freespace", ",f", freespace);
 	}
 }
@@ -904,16 +1542,16 @@ newdurecfreespace(struct context *ctx, int val)
 static void
 resizedurecfiles(size_t len)
 {
-	if (len < 0 || len == durec.fileslen)
+	if (len < 0 || len == mixer->durec.fileslen)
 		return;
-	durec.files = realloc(durec.files, len * sizeof *durec.files);
-	if (!durec.files)
+	mixer->durec.files = realloc(mixer->durec.files, len * sizeof *mixer->durec.files);
+	if (!mixer->durec.files && len > 0)
 		fatal(NULL);  /* XXX: probably shouldn't exit */
-	if (len > durec.fileslen)
-		memset(durec.files + durec.fileslen, 0, (len - durec.fileslen) * sizeof *durec.files);
-	durec.fileslen = len;
-	if (durec.index >= durec.fileslen)
-		durec.index = -1;
+	if (len > mixer->durec.fileslen)
+		memset(mixer->durec.files + mixer->durec.fileslen, 0, (len - mixer->durec.fileslen) * sizeof *mixer->durec.files);
+	mixer->durec.fileslen = len;
+	if (mixer->durec.index >= mixer->durec.fileslen)
+		mixer->durec.index = -1;
 	oscsend("/durec/numfiles", ",i", len);
 }
 
@@ -937,8 +1575,8 @@ setdurecfile(struct context *ctx, struct oscmsg *msg)
 static void
 newdurecfile(struct context *ctx, int val)
 {
-	if (val != durec.file) {
-		durec.file = val;
+	if (val != mixer->durec.file) {
+		mixer->durec.file = val;
 		oscsend(ctx->addr, ",i", val);
 	}
 }
@@ -952,13 +1590,13 @@ newdurecnext(struct context *ctx, int val)
 	int next, playmode;
 
 	next = ((val & 0xfff) ^ 0x800) - 0x800;
-	if (next != durec.next) {
-		durec.next = next;
+	if (next != mixer->durec.next) {
+		mixer->durec.next = next;
 		oscsend("/durec/next", ",i", next);
 	}
 	playmode = val >> 12;
-	if (playmode != durec.playmode) {
-		durec.playmode = playmode;
+	if (playmode != mixer->durec.playmode) {
+		mixer->durec.playmode = playmode;
 		oscsendenum("/durec/playmode", playmode, names, LEN(names));
 	}
 }
@@ -969,8 +1607,8 @@ newdurecrecordtime(struct context *ctx, int val)
 	unsigned time;
 
 	time = (unsigned)val & 0xFFFF;
-	if (time != durec.recordtime) {
-		durec.recordtime = time;
+	if (time != mixer->durec.recordtime) {
+		mixer->durec.recordtime = time;
 		oscsend("/durec/recordtime", ",i", time);
 	}
 }
@@ -978,9 +1616,11 @@ newdurecrecordtime(struct context *ctx, int val)
 static void
 newdurecindex(struct context *ctx, int val)
 {
-	if (val + 1 > durec.fileslen)
+	if (val < 0)
+		val = -1;  /* no file selected */
+	else if (val + 1 > mixer->durec.fileslen)
 		resizedurecfiles(val + 1);
-	durec.index = val;
+	mixer->durec.index = val;
 }
 
 static void
@@ -990,17 +1630,17 @@ newdurecname(struct context *ctx, int val)
 	char *pos, old[2];
 	int off;
 
-	if (durec.index == -1)
+	if (mixer->durec.index == -1)
 		return;
-	assert(durec.index < durec.fileslen);
-	f = &durec.files[durec.index];
+	assert(mixer->durec.index < mixer->durec.fileslen);
+	f = &mixer->durec.files[mixer->durec.index];
 	off = (ctx->node->ctl - DUREC_NAME0) * 2;
 	assert(off >= 0 && off < sizeof f->name);
 	pos = f->name + off;
 	memcpy(old, pos, sizeof old);
 	putle16(pos, val);
 	if (memcmp(old, pos, sizeof old) != 0)
-		oscsend("/durec/name", ",is", durec.index, f->name);
+		oscsend("/durec/name", ",is", mixer->durec.index, f->name);
 }
 
 static void
@@ -1010,18 +1650,18 @@ newdurecinfo(struct context *ctx, int val)
 	unsigned long samplerate;
 	int channels;
 
-	if (durec.index == -1)
+	if (mixer->durec.index == -1)
 		return;
-	f = &durec.files[durec.index];
+	f = &mixer->durec.files[mixer->durec.index];
 	samplerate = getsamplerate(val & 0xFF);
 	if (samplerate != f->samplerate) {
 		f->samplerate = samplerate;
-		oscsend("/durec/samplerate", ",ii", durec.index, samplerate);
+		oscsend("/durec/samplerate", ",ii", mixer->durec.index, samplerate);
 	}
 	channels = val >> 8;
 	if (channels != f->channels) {
 		f->channels = channels;
-		oscsend("/durec/channels", ",ii", durec.index, channels);
+		oscsend("/durec/channels", ",ii", mixer->durec.index, channels);
 	}
 }
 
@@ -1030,12 +1670,12 @@ newdureclength(struct context *ctx, int val)
 {
 	struct durecfile *f;
 
-	if (durec.index == -1)
+	if (mixer->durec.index == -1)
 		return;
-	f = &durec.files[durec.index];
+	f = &mixer->durec.files[mixer->durec.index];
 	if (val != f->length) {
 		f->length = val;
-		oscsend("/durec/length", ",ii", durec.index, val);
+		oscsend("/durec/length", ",ii", mixer->durec.index, val);
 	}
 }
 
@@ -1075,32 +1715,110 @@ setdurecdelete(struct context *ctx, struct oscmsg *msg)
 }
 
 static void
-setrefresh(struct context *ctx, struct oscmsg *msg)
+sendhistory(void)
 {
-	struct input *pb;
-	char addr[256];
-	int i;
-
-	dsp.vers = -1;
-	dsp.load = -1;
-	setval(ctx, device->refresh);
-	/* FIXME: needs lock */
-	for (i = 0; i < device->outputslen; ++i) {
-		pb = &inputs[device->inputslen + i];
-		snprintf(addr, sizeof addr, "/playback/%d/stereo", i + 1);
-		oscsend(addr, ",i", pb->stereo);
-	}
+	oscsend("/history", ",ii", (int)mixer->history.pos, (int)mixer->history.len);
 	oscflush();
 }
 
-static const struct node lowcuttree[] = {
-	{"freq", LOWCUT_FREQ, .set=setint, .new=newint, .min=20, .max=500},
-	{"slope", LOWCUT_SLOPE, .set=setint, .new=newint},
-	{0},
-};
+/* reverts the last applied transaction */
+static bool
+undo(void)
+{
+	struct histentry *e;
 
-static const struct node eqtree[] = {
-	{"band1freq", EQ_BAND1FREQ, .set=setint, .new=newint, .min=20, .max=20000},
+	if (mixer->history.pos == 0)
+		return false;
+	mixer->history.applying = true;
+	do {
+		e = histentry(--mixer->history.pos);
+		setreg(e->reg, e->old);
+	} while (~e->flags & HIST_BEGIN && mixer->history.pos > 0);
+	mixer->history.applying = false;
+	return true;
+}
+
+/* applies the next reverted transaction again */
+static bool
+redo(void)
+{
+	struct histentry *e;
+
+	if (mixer->history.pos == mixer->history.len)
+		return false;
+	mixer->history.applying = true;
+	do {
+		e = histentry(mixer->history.pos++);
+		setreg(e->reg, e->new);
+	} while (mixer->history.pos < mixer->history.len && ~histentry(mixer->history.pos)->flags & HIST_BEGIN);
+	mixer->history.applying = false;
+	return true;
+}
+
+static void
+setundo(struct context *ctx, struct oscmsg *msg)
+{
+	if (oscend(msg) != 0)
+		return;
+	undo();
+	sendhistory();
+}
+
+static void
+setredo(struct context *ctx, struct oscmsg *msg)
+{
+	if (oscend(msg) != 0)
+		return;
+	redo();
+	sendhistory();
+}
+
+static void
+sethistoryat(struct context *ctx, struct oscmsg *msg)
+{
+	float secs;
+	unsigned long time, ago;
+
+	secs = oscgetfloat(msg);
+	if (oscend(msg) != 0)
+		return;
+	/* the timer ticks every 100ms */
+	ago = secs > 0 ? lroundf(secs * 10) : 0;
+	time = ago < mixer->ticks ? mixer->ticks - ago : 0;
+	while (mixer->history.pos > 0 && histentry(mixer->history.pos - 1)->time > time)
+		undo();
+	while (mixer->history.pos < mixer->history.len && histentry(mixer->history.pos)->time <= time)
+		redo();
+	sendhistory();
+}
+
+static void
+setrefresh(struct context *ctx, struct oscmsg *msg)
+{
+	struct input *pb;
+	char addr[256];
+	int i;
+
+	mixer->dsp.vers = -1;
+	mixer->dsp.load = -1;
+	setval(ctx, mixer->device->refresh);
+	/* FIXME: needs lock */
+	for (i = 0; i < mixer->device->outputslen; ++i) {
+		pb = &mixer->inputs[mixer->device->inputslen + i];
+		snprintf(addr, sizeof addr, "/playback/%d/stereo", i + 1);
+		oscsend(addr, ",i", pb->stereo);
+	}
+	oscflush();
+}
+
+static const struct node lowcuttree[] = {
+	{"freq", LOWCUT_FREQ, .set=setint, .new=newint, .min=20, .max=500},
+	{"slope", LOWCUT_SLOPE, .set=setint, .new=newint},
+	{0},
+};
+
+static const struct node eqtree[] = {
+	{"band1freq", EQ_BAND1FREQ, .set=setint, .new=newint, .min=20, .max=20000},
 	{"band1gain", EQ_BAND1GAIN, .set=setfixed, .new=newfixed, .scale=0.1, .min=-200, .max=200},
 	{"band1q", EQ_BAND1Q, .set=setfixed, .new=newfixed, .scale=0.1, .min=4, .max=99},
 	{"band1type", EQ_BAND1TYPE, .set=setenum, .new=newenum, .names=(const char *const[]){
@@ -1201,7 +1919,7 @@ static const struct node roottree[] = {
 		{0},
 	}},
 	{"output", .set=setchannel, .new=newchannel, .tree=(const struct node[]){
-		{"volume", OUTPUT_VOLUME, .set=setfixed, .new=newfixed, .scale=0.1, .min=-65.0, .max=6.0},
+		{"volume", OUTPUT_VOLUME, .set=setfixed, .new=newoutputvolume, .scale=0.1, .min=-65.0, .max=6.0},
 		{"pan", OUTPUT_PAN, .set=setint, .new=newint, .min=-100, .max=100},
 		{"mute", OUTPUT_MUTE, .set=setbool, .new=newbool},
 		{"fx", OUTPUT_FXRETURN, .set=setfixed, .new=newfixed, .scale=0.1, .min=-65.0, .max=0.0},
@@ -1314,10 +2032,10 @@ static const struct node roottree[] = {
 		{0},
 	}},
 	{"durec", .tree=(const struct node[]){
-		{"play", .set=setdurecplay},
-		{"stop", .set=setdurecstop},
-		{"record", .set=setdurecrecord},
-		{"delete", .set=setdurecdelete},
+		{"play", DUREC_CONTROL, .set=setdurecplay},
+		{"stop", DUREC_CONTROL, .set=setdurecstop},
+		{"record", DUREC_CONTROL, .set=setdurecrecord},
+		{"delete", DUREC_DELETE, .set=setdurecdelete},
 		{"file", DUREC_FILE, .set=setdurecfile, .new=newdurecfile},
 		{NULL, DUREC_STATUS, .new=newdurecstatus},
 		{NULL, DUREC_TIME, .new=newdurectime},
@@ -1336,22 +2054,66 @@ static const struct node roottree[] = {
 		{NULL, DUREC_LENGTH, .new=newdureclength},
 		{0},
 	}},
+	{"gang", .set=setgang, .tree=(const struct node[]){
+		{"add", .set=setgangadd},
+		{"remove", .set=setgangremove},
+		{"clear", .set=setgangclear},
+		{"offset", .set=setgangoffset},
+		{"value", .set=setgangvalue},
+		{0},
+	}},
 	{"refresh", REFRESH, .set=setrefresh},
+	{"undo", .set=setundo},
+	{"redo", .set=setredo},
+	{"history", .tree=(const struct node[]){
+		{"at", .set=sethistoryat},
+		{0},
+	}},
 	{0},
 };
 
 /* maps control number to indices into roottree */
 static unsigned char nodeindex[NUMCTLS][4];
 
-int
-handleosc(const unsigned char *buf, size_t len)
+static void
+dispatchosc(const char *pattern, struct oscmsg *msg)
 {
 	const struct node *node;
 	struct context ctx;
-	struct oscmsg msg;
+	char *end;
+
+	ctx.pattern = pattern;
+	ctx.param.in = ctx.param.out = -1;
+	mixer->history.begin = true;
+	for (node = roottree; ctx.pattern[0] && node && node->name;) {
+		if (!oscmatch(ctx.pattern, node->name, &end)) {
+			++node;
+			continue;
+		}
+		ctx.pattern = end;
+		ctx.node = node;
+		if (node->set) {
+			ctx.exact = !ctx.pattern[0];
+			node->set(&ctx, msg);
+			if (msg->err)
+				fprintf(stderr, "%s: %s\n", pattern, msg->err);
+		}
+		node = node->tree;
+	}
+	flushregs();
+	savestate();
+}
+
+int
+handleosc(const unsigned char *buf, size_t len)
+{
+	struct oscmsg msg, args;
 	const char *pattern;
 	char *end;
+	size_t i;
+	long id;
 
+	trace(TRACE_OSCIN, 0, 0, len);
 	if (len % 4 != 0)
 		return -1;
 	msg.err = NULL;
@@ -1375,22 +2137,25 @@ handleosc(const unsigned char *buf, size_t len)
 	}
 	++msg.type;
 
-	ctx.pattern = pattern;
-	ctx.param.in = ctx.param.out = -1;
-	for (node = roottree; ctx.pattern[0] && node && node->name;) {
-		if (!oscmatch(ctx.pattern, node->name, &end)) {
-			++node;
-			continue;
-		}
-		ctx.pattern = end;
-		ctx.node = node;
-		if (node->set) {
-			ctx.exact = !ctx.pattern[0];
-			node->set(&ctx, &msg);
-			if (msg.err)
-				fprintf(stderr, "%s: %s\n", pattern, msg.err);
+	if (strcmp(pattern, "/stats") == 0) {
+		setstats(&msg);
+		return 0;
+	}
+	/* /dev/<n>/... addresses a single mixer; anything else goes to all of them */
+	if (strncmp(pattern, "/dev/", 5) == 0) {
+		id = strtol(pattern + 5, &end, 10);
+		if (end == pattern + 5 || (*end && *end != '/') || id < 1 || id > mixerslen) {
+			fprintf(stderr, "unknown device in osc address '%s'\n", pattern);
+			return -1;
 		}
-		node = node->tree;
+		mixer = mixers[id - 1];
+		dispatchosc(end, &msg);
+		return 0;
+	}
+	for (i = 0; i < mixerslen; ++i) {
+		mixer = mixers[i];
+		args = msg;
+		dispatchosc(pattern, &args);
 	}
 	return 0;
 }
@@ -1398,16 +2163,21 @@ handleosc(const unsigned char *buf, size_t len)
 static unsigned char oscbuf[8192];
 static struct oscmsg oscmsg;
 
-static void
-oscsend(const char *addr, const char *type, ...)
+/* starts a message in the current bundle; returns where its size goes */
+static unsigned char *
+oscbegin(const char *addr, const char *type)
 {
 	unsigned char *len;
-	va_list ap;
+	char devaddr[256];
 
-	_Static_assert(sizeof(float) == sizeof(uint32_t), "unsupported float type");
 	assert(addr[0] == '/');
 	assert(type[0] == ',');
 
+	if (mixerslen > 1 && mixer) {
+		snprintf(devaddr, sizeof devaddr, "/dev/%d%s", mixer->id, addr);
+		addr = devaddr;
+	}
+
 	if (!oscmsg.buf) {
 		oscmsg.buf = oscbuf;
 		oscmsg.end = oscbuf + sizeof oscbuf;
@@ -1422,11 +2192,24 @@ oscsend(const char *addr, const char *type, ...)
 	oscputint(&oscmsg, 0);
 	oscputstr(&oscmsg, addr);
 	oscputstr(&oscmsg, type);
-	oscmsg.type = ++type;
+	oscmsg.type = type + 1;
+	return len;
+}
+
+static void
+oscsend(const char *addr, const char *type, ...)
+{
+	unsigned char *len;
+	va_list ap;
+
+	_Static_assert(sizeof(float) == sizeof(uint32_t), "unsupported float type");
+	len = oscbegin(addr, type);
+	++type;
 	va_start(ap, type);
 	for (; *type; ++type) {
 		switch (*type) {
 		case 'f': oscputfloat(&oscmsg, va_arg(ap, double)); break;
+		case 'h': oscputint64(&oscmsg, va_arg(ap, int_least64_t)); break;
 		case 'i': oscputint(&oscmsg, va_arg(ap, int)); break;
 		case 's': oscputstr(&oscmsg, va_arg(ap, const char *)); break;
 		default: assert(0);
@@ -1447,15 +2230,153 @@ oscsendenum(const char *addr, int val, const char *const names[], size_t namesle
 	}
 }
 
+static void
+oscsendstrs(const char *addr, const char *const strs[], size_t len)
+{
+	unsigned char *size;
+	char type[130];
+	size_t i;
+
+	assert(len + 2 <= sizeof type);
+	type[0] = ',';
+	memset(type + 1, 's', len);
+	type[len + 1] = '\0';
+	size = oscbegin(addr, type);
+	for (i = 0; i < len; ++i)
+		oscputstr(&oscmsg, strs[i]);
+	putbe32(size, oscmsg.buf - size - 4);
+}
+
 static void
 oscflush(void)
 {
 	if (oscmsg.buf) {
+		trace(TRACE_OSCOUT, 0, 0, oscmsg.buf - oscbuf);
 		writeosc(oscbuf, oscmsg.buf - oscbuf);
 		oscmsg.buf = NULL;
 	}
 }
 
+static void
+sendlink(void)
+{
+	oscsend("/link", ",iii", (int)mixer->link.lost, (int)mixer->link.resent, (int)mixer->link.refreshes);
+}
+
+/* statistics cover the whole process, so are sent without a device
+prefix, and in bundles of their own, since they depend on timing */
+static void
+sendstats(void)
+{
+	char addr[64];
+	int i;
+
+	oscflush();
+	mixer = NULL;
+	for (i = 0; i < NUMSTATS; ++i) {
+		snprintf(addr, sizeof addr, "/stats/%s", statnames[i]);
+		oscsend(addr, ",hh", (int_least64_t)stats.count[i].count, (int_least64_t)stats.count[i].bytes);
+	}
+	for (i = 0; i < NUMTIMES; ++i) {
+		snprintf(addr, sizeof addr, "/stats/time/%s", timenames[i]);
+		oscsend(addr, ",hhhhh", (int_least64_t)stats.time[i].count,
+			(int_least64_t)statpercentile(i, 0.5), (int_least64_t)statpercentile(i, 0.99),
+			(int_least64_t)statpercentile(i, 0.999), (int_least64_t)stats.time[i].max);
+	}
+	oscflush();
+}
+
+static void
+setstats(struct oscmsg *msg)
+{
+	int_least32_t period;
+
+	if (*msg->type) {
+		period = oscgetint(msg);
+		if (oscend(msg) != 0 || period < 0) {
+			fprintf(stderr, "/stats: %s\n", msg->err ? msg->err : "invalid period");
+			return;
+		}
+		statsperiod = period * 10;
+		statsticks = 0;
+	}
+	sendstats();
+}
+
+/* reads back the whole device, only reporting registers that changed */
+static void
+requestrefresh(void)
+{
+	struct param p;
+	int reg, i;
+
+	mixer->resync = 20;
+	mixer->serialack = -1;
+	for (i = 0; i < LEN(mixer->windows); ++i)
+		mixer->windows[i].pending = false;
+	p.in = p.out = -1;
+	reg = ctltoreg(REFRESH, &p);
+	if (reg != -1)
+		setreg(reg, mixer->device->refresh);
+}
+
+/* writes the registers of a window that may not have reached the device again */
+static void
+resendwindow(struct serialwindow *w)
+{
+	size_t i;
+	int reg;
+
+	++mixer->link.lost;
+	if (w->overflow) {
+		++mixer->link.refreshes;
+		requestrefresh();
+		return;
+	}
+	for (i = 0; i < w->rangeslen; ++i) {
+		for (reg = w->ranges[i].first; reg <= w->ranges[i].last; ++reg) {
+			if (mixer->regctl[reg].flags & REG_COMMAND)
+				continue;
+			if (mixer->regimage[reg] != -1)
+				setreg(reg, mixer->regimage[reg]);
+			if (mixer->regctl[reg].ctl == MIX && mixer->regimage[reg | 0x8000] != -1)
+				setreg(reg, mixer->regimage[reg | 0x8000]);
+		}
+	}
+	mixer->link.resent += w->rangeslen;
+}
+
+static void
+ackserial(int serial)
+{
+	struct serialwindow *w;
+	int i;
+	bool lost;
+
+	serial &= 0xf;
+	if (!mixer->windows[serial].pending)
+		return;
+	/* earlier windows that are still pending were never echoed */
+	lost = false;
+	i = mixer->serialack == -1 ? mixer->serial : (mixer->serialack + 1) & 0xf;
+	for (; i != serial; i = (i + 1) & 0xf) {
+		w = &mixer->windows[i];
+		if (!w->pending)
+			continue;
+		w->pending = false;
+		if (mixer->serialack != -1) {
+			lost = true;
+			resendwindow(w);
+		}
+	}
+	mixer->windows[serial].pending = false;
+	/* unless a full refresh was requested instead */
+	if (!lost || mixer->serialack != -1)
+		mixer->serialack = serial;
+	if (lost)
+		sendlink();
+}
+
 static void
 handleregs(uint_least32_t *payload, size_t len)
 {
@@ -1469,17 +2390,21 @@ handleregs(uint_least32_t *payload, size_t len)
 
 	ctx.addr = addr;
 	ctx.addrend = addr + sizeof addr;
+	mixer->history.reporting = true;
 	for (i = 0; i < len; ++i) {
 		reg = payload[i] >> 16 & 0x7fff;
 		val = (long)((payload[i] & 0xffff) ^ 0x8000) - 0x8000;
-		ctx.param.in = ctx.param.out = -1;
-		ctl = device->regtoctl(reg, &ctx.param);
-		if (ctl == -1) {
-			if (dflag)
-				fprintf(stderr, "[%.4X]=%.4X\n", reg, val & 0xFFFFU);
+		trace(TRACE_DEVREG, mixer->id, reg, val & 0xffff);
+		if (reg == 0x3F00) {
+			ackserial(val);
 			continue;
 		}
-		if (ctl == UNKNOWN)
+		if (mixer->resync > 0 && mixer->regimage[imageslot(reg, val & 0xffff)] == (val & 0xffff))
+			continue;
+		setimage(reg, val & 0xffff);
+		ctx.param.in = ctx.param.out = -1;
+		ctl = regtoctl(reg, &ctx.param);
+		if (ctl == -1 || ctl == UNKNOWN)
 			continue;
 		assert(ctl < LEN(nodeindex));
 		assert(nodeindex[ctl][0] != 0xFF);
@@ -1502,19 +2427,20 @@ handleregs(uint_least32_t *payload, size_t len)
 			tree = node->tree;
 		}
 	}
+	mixer->history.reporting = false;
 }
 
 static void
 handlelevels(int subid, uint_least32_t *payload, size_t len)
 {
-	static uint_least32_t inputpeakfx[22], outputpeakfx[22];
-	static uint_least64_t inputrmsfx[22], outputrmsfx[22];
 	uint_least32_t peak, *peakfx;
 	uint_least64_t rms, *rmsfx;
 	float peakdb, peakfxdb, rmsdb, rmsfxdb;
 	const char *type;
 	char addr[128];
-	size_t i;
+	struct meter *meter;
+	uint32_t seq;
+	size_t i, n;
 
 	if (len % 3 != 0) {
 		fprintf(stderr, "unexpected levels data\n");
@@ -1526,12 +2452,28 @@ handlelevels(int subid, uint_least32_t *payload, size_t len)
 	rmsfx = NULL;
 	switch (subid) {
 	case 4: type = "input";  /* fallthrough */
-	case 1: peakfx = inputpeakfx, rmsfx = inputrmsfx; break;
+	case 1: peakfx = mixer->peakfxs, rmsfx = mixer->rmsfxs, n = mixer->device->inputslen; break;
 	case 5: type = "output";  /* fallthrough */
-	case 3: peakfx = outputpeakfx, rmsfx = outputrmsfx; break;
-	case 2: type = "playback"; break;
+	case 3: peakfx = mixer->peakfxs + mixer->device->inputslen, rmsfx = mixer->rmsfxs + mixer->device->inputslen, n = mixer->device->outputslen; break;
+	case 2: type = "playback", n = mixer->device->outputslen; break;
 	default: assert(0);
 	}
+	/* ignore any channels beyond those the device describes */
+	if (len > n)
+		len = n;
+	meter = NULL;
+	seq = 0;
+	if (type && mixer->meters) {
+		meter = (struct meter *)(mixer->meters + 1);
+		switch (subid) {
+		case 2: meter += mixer->device->inputslen; break;
+		case 5: meter += mixer->device->inputslen + mixer->device->outputslen; break;
+		}
+		/* seqlock: readers retry while seq is odd or has changed */
+		seq = atomic_load_explicit(&mixer->meters->seq, memory_order_relaxed);
+		atomic_store_explicit(&mixer->meters->seq, seq + 1, memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+	}
 	for (i = 0; i < len; ++i) {
 		rms = *payload++;
 		rms |= (uint_least64_t)*payload++ << 32;
@@ -1545,23 +2487,37 @@ handlelevels(int subid, uint_least32_t *payload, size_t len)
 				rmsfxdb = 10 * log10(rmsfx[i] / 0x1p54);
 				oscsend(addr, ",ffffi", peakdb, rmsdb, peakfxdb, rmsfxdb, (int)(peak & peakfx[i] & 1));
 			} else {
+				peakfxdb = rmsfxdb = -INFINITY;
 				oscsend(addr, ",ffi", peakdb, rmsdb, (int)(peak & 1));
 			}
+			if (meter) {
+				meter->peak = peakdb;
+				meter->rms = rmsdb;
+				meter->peakfx = peakfxdb;
+				meter->rmsfx = rmsfxdb;
+				meter->clip = peak & (peakfx ? peakfx[i] : 1) & 1;
+				++meter;
+			}
 		} else {
 			*peakfx++ = peak;
 			*rmsfx++ = rms;
 		}
 	}
+	if (meter) {
+		++mixer->meters->frame;
+		atomic_store_explicit(&mixer->meters->seq, seq + 2, memory_order_release);
+	}
 }
 
 void
-handlesysex(const unsigned char *buf, size_t len, uint_least32_t *payload)
+handlesysex(struct mixer *m, const unsigned char *buf, size_t len, uint_least32_t *payload)
 {
 	struct sysex sysex;
 	int ret;
 	size_t i;
 	uint_least32_t *pos;
 
+	mixer = m;
 	ret = sysexdec(&sysex, buf, len, SYSEX_MFRID | SYSEX_DEVID | SYSEX_SUBID);
 	if (ret != 0 || sysex.mfrid != 0x200d || sysex.devid != 0x10 || sysex.datalen % 5 != 0) {
 		if (ret == 0)
@@ -1570,14 +2526,14 @@ handlesysex(const unsigned char *buf, size_t len, uint_least32_t *payload)
 			fprintf(stderr, "ignoring unknown sysex packet\n");
 		return;
 	}
+	trace(TRACE_SYSEXIN, m->id, sysex.subid, len);
 	pos = payload;
 	for (i = 0; i < sysex.datalen; i += 5)
 		*pos++ = getle32_7bit(sysex.data + i);
 	switch (sysex.subid) {
 	case 0:
 		handleregs(payload, pos - payload);
-		fflush(stdout);
-		fflush(stderr);
+		savestate();
 		break;
 	case 1: case 2: case 3: case 4: case 5:
 		handlelevels(sysex.subid, payload, pos - payload);
@@ -1585,22 +2541,397 @@ handlesysex(const unsigned char *buf, size_t len, uint_least32_t *payload)
 	default:
 		fprintf(stderr, "ignoring unknown sysex sub ID\n");
 	}
+	flushregs();
 	oscflush();
 }
 
 void
 handletimer(bool levels)
 {
-	static int serial;
 	unsigned char buf[7];
+	struct serialwindow *w;
+	size_t i;
 
-	if (levels) {
-		/* XXX: ~60 times per second levels, ~30 times per second serial */
-		writesysex(2, NULL, 0, buf);
+	trace(TRACE_TIMER, 0, 0, levels);
+	for (i = 0; i < mixerslen; ++i) {
+		mixer = mixers[i];
+		if (levels) {
+			/* XXX: ~60 times per second levels, ~30 times per second serial */
+			writesysex(2, NULL, 0, buf);
+		}
+
+		setreg(0x3F00, mixer->serial);
+		flushregs();
+		mixer->windows[mixer->serial].pending = true;
+		mixer->serial = (mixer->serial + 1) & 0xf;
+		w = &mixer->windows[mixer->serial];
+		if (w->pending && mixer->serialack != -1) {
+			/* no echo for a whole cycle of serials */
+			++mixer->link.lost;
+			++mixer->link.refreshes;
+			requestrefresh();
+			flushregs();
+			sendlink();
+			oscflush();
+		}
+		w->pending = false;
+		w->overflow = false;
+		w->rangeslen = 0;
+		if (mixer->resync > 0)
+			--mixer->resync;
+		++mixer->ticks;
 	}
+	if (statsperiod > 0 && ++statsticks >= statsperiod) {
+		statsticks = 0;
+		sendstats();
+	}
+}
+
+void
+handlelost(struct mixer *m)
+{
+	mixer = m;
+	trace(TRACE_LOST, m->id, 0, 0);
+	++m->link.refreshes;
+	requestrefresh();
+	flushregs();
+	sendlink();
+	oscflush();
+}
 
-	setreg(0x3F00, serial);
-	serial = (serial + 1) & 0xf;
+void
+handleconnect(struct mixer *m, bool connected)
+{
+	mixer = m;
+	trace(TRACE_CONNECT, m->id, 0, connected);
+	if (m->connected == connected)
+		return;
+	m->connected = connected;
+	m->serialack = -1;
+	oscsend("/status", ",s", connected ? "connected" : "disconnected");
+	if (connected) {
+		/* read back the device state, only reporting what changed while it was away */
+		requestrefresh();
+		flushregs();
+	}
+	oscflush();
+}
+
+static uint32_t
+checksum(const void *ptr, size_t len)
+{
+	const uint32_t *pos;
+	uint32_t sum;
+	size_t i;
+
+	pos = ptr;
+	sum = 0;
+	for (i = 0; i < len / 4; ++i)
+		sum += (uint32_t)(i + 1) * pos[i];
+	return sum;
+}
+
+/* returns the derived state region following the register image */
+static void *
+statederived(struct statehdr *hdr, size_t *len)
+{
+	*len = hdr->size - sizeof *hdr - IMAGELEN * sizeof(int32_t);
+	return (int32_t *)(hdr + 1) + IMAGELEN;
+}
+
+size_t
+statesize(struct mixer *m)
+{
+	size_t chans, outs;
+
+	chans = m->device->inputslen + m->device->outputslen;
+	outs = m->device->outputslen;
+	return sizeof(struct statehdr) + IMAGELEN * sizeof(int32_t)
+		+ chans * sizeof(struct stateinput) + outs * sizeof(struct stateoutput)
+		+ outs * chans * sizeof(float)
+		+ sizeof(uint32_t) + STATEFILES * sizeof(struct statefile);
+}
+
+size_t
+metersize(struct mixer *m)
+{
+	return sizeof(struct meterhdr) + (m->device->inputslen + 2 * m->device->outputslen) * sizeof(struct meter);
+}
+
+/* publishes level meters in mem from now on */
+void
+setmeters(struct mixer *m, void *mem)
+{
+	struct meterhdr *hdr;
+
+	hdr = mem;
+	memset(hdr, 0, metersize(m));
+	memcpy(hdr->magic, METERMAGIC, sizeof hdr->magic);
+	hdr->version = METERVERSION;
+	hdr->inputslen = m->device->inputslen;
+	hdr->outputslen = m->device->outputslen;
+	snprintf(hdr->device, sizeof hdr->device, "%s", m->device->id);
+	m->meters = hdr;
+}
+
+size_t
+snapsize(struct mixer *m)
+{
+	size_t chans, outs;
+
+	chans = m->device->inputslen + m->device->outputslen;
+	outs = m->device->outputslen;
+	return sizeof(struct snaphdr) + SNAPREGS * sizeof(int32_t)
+		+ (m->device->inputslen + outs) * 12 + outs * chans * sizeof(struct snapmix);
+}
+
+/* publishes the state in mem from now on */
+void
+setsnapshot(struct mixer *m, void *mem)
+{
+	struct snaphdr *hdr;
+
+	hdr = mem;
+	memset(hdr, 0, snapsize(m));
+	memcpy(hdr->magic, SNAPMAGIC, sizeof hdr->magic);
+	hdr->version = SNAPVERSION;
+	hdr->size = snapsize(m);
+	snprintf(hdr->device, sizeof hdr->device, "%s", m->device->id);
+	hdr->inputslen = m->device->inputslen;
+	hdr->outputslen = m->device->outputslen;
+	hdr->regsoff = sizeof *hdr;
+	hdr->namesoff = hdr->regsoff + SNAPREGS * sizeof(int32_t);
+	hdr->mixoff = hdr->namesoff + (hdr->inputslen + hdr->outputslen) * 12;
+	m->snap = hdr;
+	m->snapdirty = true;
+	mixer = m;
+	publishsnap();
+}
+
+/* rewrites the published state under a seqlock, if it changed */
+static void
+publishsnap(void)
+{
+	struct snaphdr *hdr;
+	struct snapmix *mix;
+	struct level level;
+	struct param param;
+	char (*names)[12];
+	uint32_t gen;
+	size_t i, j, chans;
+	int reg, val, k;
+
+	hdr = mixer->snap;
+	if (!hdr || !mixer->snapdirty)
+		return;
+	mixer->snapdirty = false;
+	gen = atomic_load_explicit(&hdr->generation, memory_order_relaxed);
+	atomic_store_explicit(&hdr->generation, gen + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	memcpy((char *)hdr + hdr->regsoff, mixer->regimage, SNAPREGS * sizeof(int32_t));
+	names = (char (*)[12])((char *)hdr + hdr->namesoff);
+	for (i = 0; i < hdr->inputslen + hdr->outputslen; ++i) {
+		param.in = i < hdr->inputslen ? i : -1;
+		param.out = i < hdr->inputslen ? -1 : i - hdr->inputslen;
+		reg = ctltoreg(NAME, &param);
+		/* names are only known once set; until then, use the default */
+		if (reg == -1 || mixer->regimage[reg] == -1) {
+			memcpy(names[i], i < hdr->inputslen ? mixer->device->inputs[i].name : mixer->device->outputs[param.out].name, 12);
+			continue;
+		}
+		for (k = 0; k < 12; k += 2) {
+			val = mixer->regimage[reg + k / 2];
+			names[i][k] = val == -1 ? 0 : val & 0xff;
+			names[i][k + 1] = val == -1 ? 0 : val >> 8 & 0xff;
+		}
+		names[i][11] = '\0';
+	}
+	mix = (struct snapmix *)((char *)hdr + hdr->mixoff);
+	chans = mixer->device->inputslen + mixer->device->outputslen;
+	for (i = 0; i < mixer->device->outputslen; ++i) {
+		for (j = 0; j < chans; ++j, ++mix) {
+			calclevel(&mixer->outputs[i], &mixer->inputs[j], 1, &level);
+			mix->db = level.vol > 0 ? 20.f * log10f(level.vol) : -INFINITY;
+			mix->pan = level.pan;
+		}
+	}
+	hdr->durec.status = mixer->durec.status;
+	hdr->durec.position = mixer->durec.position;
+	hdr->durec.time = mixer->durec.time;
+	hdr->durec.usbload = mixer->durec.usbload;
+	hdr->durec.totalspace = mixer->durec.totalspace;
+	hdr->durec.freespace = mixer->durec.freespace;
+	hdr->durec.fileslen = mixer->durec.fileslen;
+	hdr->durec.file = mixer->durec.file;
+
+	atomic_store_explicit(&hdr->generation, gen + 2, memory_order_release);
+}
+
+/* rewrites the derived state in the state file, if it changed */
+static void
+savestate(void)
+{
+	struct statehdr *hdr;
+	struct stateinput *si;
+	struct stateoutput *so;
+	struct statefile *sf;
+	float *mix;
+	uint32_t *fileslen;
+	size_t i, n, chans, len;
+	void *derived;
+
+	publishsnap();
+	hdr = mixer->state;
+	if (!hdr || !mixer->statedirty)
+		return;
+	mixer->statedirty = false;
+	chans = mixer->device->inputslen + mixer->device->outputslen;
+	derived = statederived(hdr, &len);
+	si = derived;
+	for (i = 0; i < chans; ++i, ++si) {
+		si->stereo = mixer->inputs[i].stereo;
+		si->mute = mixer->inputs[i].mute;
+		si->width = mixer->inputs[i].width;
+		si->gain = mixer->inputs[i].gain;
+	}
+	so = (struct stateoutput *)si;
+	for (i = 0; i < mixer->device->outputslen; ++i, ++so) {
+		so->stereo = mixer->outputs[i].stereo;
+		so->volume = mixer->outputs[i].volume;
+	}
+	mix = (float *)so;
+	for (i = 0; i < mixer->device->outputslen; ++i, mix += chans)
+		memcpy(mix, mixer->outputs[i].mix, chans * sizeof *mix);
+	fileslen = (uint32_t *)mix;
+	n = mixer->durec.fileslen < STATEFILES ? mixer->durec.fileslen : STATEFILES;
+	*fileslen = n;
+	sf = (struct statefile *)(fileslen + 1);
+	memset(sf, 0, STATEFILES * sizeof *sf);
+	for (i = 0; i < n; ++i, ++sf) {
+		memcpy(sf->name, mixer->durec.files[i].name, sizeof mixer->durec.files[i].name);
+		sf->samplerate = mixer->durec.files[i].samplerate;
+		sf->channels = mixer->durec.files[i].channels;
+		sf->length = mixer->durec.files[i].length;
+	}
+	hdr->derivedsum = checksum(derived, len);
+	++hdr->generation;
+}
+
+/* restores the derived state saved by savestate */
+static void
+restorestate(void)
+{
+	struct statehdr *hdr;
+	const struct stateinput *si;
+	const struct stateoutput *so;
+	const struct statefile *sf;
+	const float *mix;
+	const uint32_t *fileslen;
+	struct durecfile *f;
+	size_t i, chans, len;
+	void *derived;
+
+	hdr = mixer->state;
+	derived = statederived(hdr, &len);
+	if (checksum(derived, len) != hdr->derivedsum) {
+		fprintf(stderr, "state file has inconsistent mixer state; ignoring it\n");
+		return;
+	}
+	chans = mixer->device->inputslen + mixer->device->outputslen;
+	si = derived;
+	for (i = 0; i < chans; ++i, ++si) {
+		mixer->inputs[i].stereo = si->stereo;
+		mixer->inputs[i].mute = si->mute;
+		mixer->inputs[i].width = si->width;
+		mixer->inputs[i].gain = si->gain;
+	}
+	so = (const struct stateoutput *)si;
+	for (i = 0; i < mixer->device->outputslen; ++i, ++so) {
+		mixer->outputs[i].stereo = so->stereo;
+		mixer->outputs[i].volume = so->volume;
+	}
+	mix = (const float *)so;
+	for (i = 0; i < mixer->device->outputslen; ++i, mix += chans)
+		memcpy(mixer->outputs[i].mix, mix, chans * sizeof *mix);
+	fileslen = (const uint32_t *)mix;
+	if (*fileslen > STATEFILES)
+		return;
+	resizedurecfiles(*fileslen);
+	sf = (const struct statefile *)(fileslen + 1);
+	for (i = 0; i < mixer->durec.fileslen; ++i, ++sf) {
+		f = &mixer->durec.files[i];
+		memcpy(f->name, sf->name, sizeof f->name - 1);
+		f->samplerate = sf->samplerate;
+		f->channels = sf->channels;
+		f->length = sf->length;
+		oscsend("/durec/name", ",is", (int)i, f->name);
+		oscsend("/durec/samplerate", ",ii", (int)i, (int)f->samplerate);
+		oscsend("/durec/channels", ",ii", (int)i, (int)f->channels);
+		oscsend("/durec/length", ",ii", (int)i, (int)f->length);
+	}
+}
+
+/* binds the mixer to statesize(m) bytes at mem, restoring the state there if it is valid */
+int
+loadstate(struct mixer *m, void *mem)
+{
+	struct statehdr *hdr;
+	int32_t *regs;
+	uint_least32_t payload[256];
+	size_t i, n;
+	bool valid, connected;
+
+	mixer = m;
+	hdr = mem;
+	regs = (int32_t *)(hdr + 1);
+	valid = memcmp(hdr->magic, "OSCMIXST", 8) == 0
+		&& hdr->version == STATEVERSION
+		&& hdr->size == statesize(m)
+		&& strncmp(hdr->device, m->device->id, sizeof hdr->device) == 0
+		&& hdr->inputslen == m->device->inputslen
+		&& hdr->outputslen == m->device->outputslen
+		&& hdr->fileslen == STATEFILES
+		&& hdr->regsum == checksum(regs, IMAGELEN * sizeof *regs);
+	if (!valid) {
+		memset(hdr, 0, sizeof *hdr);
+		memcpy(hdr->magic, "OSCMIXST", 8);
+		hdr->version = STATEVERSION;
+		hdr->size = statesize(m);
+		snprintf(hdr->device, sizeof hdr->device, "%s", m->device->id);
+		hdr->inputslen = m->device->inputslen;
+		hdr->outputslen = m->device->outputslen;
+		hdr->fileslen = STATEFILES;
+		memcpy(regs, m->regimage, IMAGELEN * sizeof *regs);
+		hdr->regsum = checksum(regs, IMAGELEN * sizeof *regs);
+	}
+	free(m->regimage);
+	m->regimage = regs;
+	m->state = hdr;
+	if (valid) {
+		restorestate();
+		/* replay the image to clients without writing to the device */
+		connected = m->connected;
+		m->connected = false;
+		n = 0;
+		for (i = 0; i < IMAGELEN; ++i) {
+			if (regs[i] == -1)
+				continue;
+			payload[n++] = (uint_least32_t)(i & 0x7fff) << 16 | regs[i];
+			if (n == LEN(payload)) {
+				handleregs(payload, n);
+				n = 0;
+			}
+		}
+		handleregs(payload, n);
+		flushregs();
+		m->connected = connected;
+		m->resync = 20;
+	}
+	m->statedirty = true;
+	savestate();
+	oscflush();
+	return valid;
 }
 
 static void
@@ -1621,56 +2952,183 @@ maptree(const struct node *tree, int i)
 	}
 }
 
-int
-init(const char *port)
+static void
+mapreg(const struct regmap *map, int reg, struct param *p)
 {
-	extern const struct device ffucxii;
-	static const struct device *devices[] = {
-		&ffucxii,
-	};
-	int i;
-	size_t namelen;
+	int slot;
+
+	assert(reg >= 0 && reg < 0x8000);
+	mixer->regctl[reg].flags |= map->flags & (REG_RDONLY | REG_COMMAND);
+	if (~map->flags & REG_WRONLY && mixer->regctl[reg].ctl == -1) {
+		mixer->regctl[reg].ctl = map->ctl;
+		mixer->regctl[reg].in = p->in;
+		mixer->regctl[reg].out = p->out;
+	}
+	if (map->flags & REG_RDONLY || map->ctl == UNKNOWN)
+		return;
+	if (p->in != -1 && p->out != -1) {
+		/* mix registers are stored for the first output */
+		if (p->out != 0)
+			return;
+		slot = 1 + p->in;
+		mixer->ctlstride[map->ctl] = map->stride;
+	} else {
+		slot = ctlslot(p);
+	}
+	mixer->ctlreg[map->ctl * mixer->ctlslots + slot] = reg;
+}
+
+static int
+mapregs(void)
+{
+	const struct regmap *map;
+	struct param p;
+	int i, in, out, ins, outs, first, flags, reg;
 
-	for (i = 0; i < LEN(devices); ++i) {
+	assert(mixer->device->inputslen + mixer->device->outputslen <= SCHAR_MAX);
+	mixer->regctl = malloc(0x8000 * sizeof *mixer->regctl);
+	mixer->ctlslots = 1 + mixer->device->inputslen + 2 * mixer->device->outputslen;
+	mixer->ctlreg = malloc(NUMCTLS * mixer->ctlslots * sizeof *mixer->ctlreg);
+	if (!mixer->regctl || !mixer->ctlreg)
+		return -1;
+	for (i = 0; i < 0x8000; ++i) {
+		mixer->regctl[i].ctl = -1;
+		mixer->regctl[i].in = -1;
+		mixer->regctl[i].out = -1;
+		mixer->regctl[i].flags = 0;
+	}
+	for (i = 0; i < NUMCTLS * mixer->ctlslots; ++i)
+		mixer->ctlreg[i] = -1;
+	for (map = mixer->device->regmap; map != mixer->device->regmap + mixer->device->regmaplen; ++map) {
+		first = 0;
+		ins = 1;
+		if (map->flags & REG_INPUT) {
+			ins = mixer->device->inputslen;
+		} else if (map->flags & REG_PLAYBACK) {
+			first = mixer->device->inputslen;
+			ins = mixer->device->outputslen;
+		}
+		outs = map->flags & REG_OUTPUT ? mixer->device->outputslen : 1;
+		for (out = 0; out < outs; ++out) {
+			p.out = map->flags & REG_OUTPUT ? out : -1;
+			for (in = 0; in < ins; ++in) {
+				p.in = map->flags & (REG_INPUT | REG_PLAYBACK) ? first + in : -1;
+				if (p.in != -1 && p.out != -1) {
+					reg = map->reg + out * map->stride + in;
+				} else {
+					i = p.in != -1 ? in : out;
+					if (map->flags & REG_PAIR)
+						i >>= 1;
+					reg = map->reg + i * map->stride;
+					flags = 0;
+					if (map->flags & REG_INPUT)
+						flags = mixer->device->inputs[in].flags;
+					else if (map->flags & REG_OUTPUT)
+						flags = mixer->device->outputs[out].flags;
+					if ((flags & map->chanflags) != map->chanflags)
+						continue;
+				}
+				mapreg(map, reg, &p);
+			}
+		}
+	}
+	return 0;
+}
+
+static const struct device *
+finddevice(const char *port)
+{
+	const struct device *device;
+	size_t i, namelen;
+
+	for (i = 0; i < deviceslen; ++i) {
 		device = devices[i];
 		if (strcmp(port, device->id) == 0)
-			break;
+			return device;
 		namelen = strlen(device->name);
 		if (strncmp(port, device->name, namelen) == 0) {
 			if (!port[namelen] || (port[namelen] == ' ' && port[namelen + 1] == '('))
-				break;
+				return device;
 		}
 	}
-	if (i == LEN(devices)) {
+	return NULL;
+}
+
+bool
+supported(const char *port)
+{
+	return finddevice(port) != NULL;
+}
+
+struct mixer *
+newmixer(const char *port, void *arg)
+{
+	const struct device *device;
+	struct mixer *m, **newmixers;
+	int i;
+
+	device = finddevice(port);
+	if (!device) {
 		fprintf(stderr, "unsupported device '%s'\n", port);
-		return -1;
+		return NULL;
 	}
 
-	memset(nodeindex, 0xFF, sizeof nodeindex);
-	maptree(roottree, 0);
+	if (mixerslen == 0) {
+		memset(nodeindex, 0xFF, sizeof nodeindex);
+		maptree(roottree, 0);
+	}
+	m = calloc(1, sizeof *m);
+	newmixers = realloc(mixers, (mixerslen + 1) * sizeof *mixers);
+	if (!m || !newmixers) {
+		perror(NULL);
+		return NULL;
+	}
+	mixers = newmixers;
+	m->id = mixerslen + 1;
+	tracedevice(m->id, device->id);
+	m->arg = arg;
+	m->device = device;
+	m->durec.index = -1;
+	m->serialack = -1;
+	m->connected = true;
+	m->regimage = malloc(IMAGELEN * sizeof *m->regimage);
+	if (!m->regimage) {
+		perror(NULL);
+		return NULL;
+	}
+	for (i = 0; i < IMAGELEN; ++i)
+		m->regimage[i] = -1;
+	mixer = m;
+	if (mapregs() != 0) {
+		perror(NULL);
+		return NULL;
+	}
 
-	inputs = calloc(device->inputslen + device->outputslen, sizeof *inputs);
-	outputs = calloc(device->outputslen, sizeof *outputs);
-	if (!inputs || !outputs) {
+	m->inputs = calloc(device->inputslen + device->outputslen, sizeof *m->inputs);
+	m->outputs = calloc(device->outputslen, sizeof *m->outputs);
+	m->peakfxs = calloc(device->inputslen + device->outputslen, sizeof *m->peakfxs);
+	m->rmsfxs = calloc(device->inputslen + device->outputslen, sizeof *m->rmsfxs);
+	if (!m->inputs || !m->outputs || !m->peakfxs || !m->rmsfxs) {
 		perror(NULL);
-		return -1;
+		return NULL;
 	}
 	for (i = 0; i < device->inputslen + device->outputslen; ++i) {
 		struct input *in;
 
-		in = &inputs[i];
+		in = &m->inputs[i];
 		in->width = 100;
 	}
 	for (i = 0; i < device->outputslen; ++i) {
 		struct output *out;
 
-		inputs[device->inputslen + i].stereo = true;
-		out = &outputs[i];
+		m->inputs[device->inputslen + i].stereo = true;
+		out = &m->outputs[i];
 		out->mix = calloc(device->inputslen + device->outputslen, sizeof *out->mix);
 		if (!out->mix) {
 			perror(NULL);
-			return -1;
+			return NULL;
 		}
 	}
-	return 0;
+	mixers[mixerslen++] = m;
+	return m;
 }
@@ -1,13 +1,24 @@
 #ifndef OSCMIX_H
 #define OSCMIX_H
 
-int init(const char *port);
+struct mixer;
 
-void handlesysex(const unsigned char *buf, size_t len, uint32_t *payload);
+bool supported(const char *port);
+struct mixer *newmixer(const char *port, void *arg);
+size_t statesize(struct mixer *m);
+int loadstate(struct mixer *m, void *mem);
+size_t metersize(struct mixer *m);
+void setmeters(struct mixer *m, void *mem);
+size_t snapsize(struct mixer *m);
+void setsnapshot(struct mixer *m, void *mem);
+
+void handlesysex(struct mixer *m, const unsigned char *buf, size_t len, uint32_t *payload);
 int handleosc(const unsigned char *buf, size_t len);
 void handletimer(bool levels);
+void handleconnect(struct mixer *m, bool connected);
+void handlelost(struct mixer *m);
 
-extern void writemidi(const void *buf, size_t len);
+extern void writemidi(void *arg, const void *buf, size_t len);
 extern void writeosc(const void *buf, size_t len);
 
 #endif
@@ -0,0 +1,161 @@
+#define _XOPEN_SOURCE 700
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "rawmidi.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sound/asound.h>
+
+static int
+opensubdev(int ctlfd, int card, int dev, int subdev)
+{
+	int fd, ver;
+	char path[64];
+	struct snd_rawmidi_params params;
+	struct snd_rawmidi_info info;
+
+	if (ioctl(ctlfd, SNDRV_CTL_IOCTL_RAWMIDI_PREFER_SUBDEVICE, &subdev) != 0)
+		return -1;
+	snprintf(path, sizeof path, "/dev/snd/midiC%dD%d", card, dev);
+	fd = open(path, O_RDWR | O_CLOEXEC | O_NONBLOCK);
+	if (fd < 0)
+		return -1;
+	if (ioctl(fd, (int)SNDRV_RAWMIDI_IOCTL_PVERSION, &ver) != 0)
+		goto error;
+	if (SNDRV_PROTOCOL_INCOMPATIBLE(ver, SNDRV_RAWMIDI_VERSION)) {
+		errno = EPROTO;
+		goto error;
+	}
+	info.stream = SNDRV_RAWMIDI_STREAM_INPUT;
+	if (ioctl(fd, (int)SNDRV_RAWMIDI_IOCTL_INFO, &info) != 0)
+		goto error;
+	if (info.subdevice != subdev) {
+		errno = EBUSY;
+		goto error;
+	}
+	memset(&params, 0, sizeof params);
+	params.stream = SNDRV_RAWMIDI_STREAM_INPUT;
+	params.buffer_size = 8192;
+	params.avail_min = 1;
+	params.no_active_sensing = 1;
+	if (ioctl(fd, (int)SNDRV_RAWMIDI_IOCTL_PARAMS, &params) != 0)
+		goto error;
+	params.stream = SNDRV_RAWMIDI_STREAM_OUTPUT;
+	if (ioctl(fd, (int)SNDRV_RAWMIDI_IOCTL_PARAMS, &params) != 0)
+		goto error;
+	return fd;
+
+error:
+	close(fd);
+	return -1;
+}
+
+/* opens the first free subdevice named port, or accepted by match if port is NULL */
+int
+rawmidiopen(const char *port, bool (*match)(const char *), char *name, size_t namelen)
+{
+	int card, ctlfd, dev, subdev, fd;
+	char path[64], *subname;
+	struct snd_rawmidi_info info;
+
+	for (card = 0; card < 32; ++card) {
+		snprintf(path, sizeof path, "/dev/snd/controlC%d", card);
+		ctlfd = open(path, O_RDWR | O_CLOEXEC);
+		if (ctlfd < 0)
+			continue;
+		dev = -1;
+		while (ioctl(ctlfd, SNDRV_CTL_IOCTL_RAWMIDI_NEXT_DEVICE, &dev) == 0 && dev >= 0) {
+			memset(&info, 0, sizeof info);
+			info.device = dev;
+			info.stream = SNDRV_RAWMIDI_STREAM_INPUT;
+			if (ioctl(ctlfd, SNDRV_CTL_IOCTL_RAWMIDI_INFO, &info) != 0)
+				continue;
+			/* RME devices expose the control port as the last subdevice */
+			for (subdev = info.subdevices_count; subdev-- > 0;) {
+				info.subdevice = subdev;
+				if (ioctl(ctlfd, SNDRV_CTL_IOCTL_RAWMIDI_INFO, &info) != 0)
+					continue;
+				subname = (char *)info.subname;
+				if (port ? strncmp(subname, port, strlen(port)) != 0 : !match(subname))
+					continue;
+				fd = opensubdev(ctlfd, card, dev, subdev);
+				if (fd >= 0) {
+					close(ctlfd);
+					snprintf(name, namelen, "%.*s", (int)sizeof info.subname, subname);
+					return fd;
+				}
+			}
+		}
+		close(ctlfd);
+	}
+	errno = ENODEV;
+	return -1;
+}
+
+/* returns an inotify descriptor reporting new or changed device nodes */
+int
+rawmidiwatch(void)
+{
+	int fd;
+
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	if (inotify_add_watch(fd, "/dev/snd", IN_CREATE | IN_ATTRIB) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* drains the watch descriptor and reports whether any raw MIDI node appeared */
+bool
+rawmidichanged(int fd)
+{
+	union {
+		struct inotify_event evt;
+		char buf[4096];
+	} u;
+	struct inotify_event *evt;
+	ssize_t ret;
+	char *pos;
+	bool changed;
+
+	changed = false;
+	while ((ret = read(fd, u.buf, sizeof u.buf)) > 0) {
+		for (pos = u.buf; pos < u.buf + ret; pos += sizeof *evt + evt->len) {
+			evt = (struct inotify_event *)pos;
+			if (evt->len > 0 && strncmp(evt->name, "midiC", 5) == 0)
+				changed = true;
+		}
+	}
+	return changed;
+}
+#else
+int
+rawmidiopen(const char *port, bool (*match)(const char *), char *name, size_t namelen)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int
+rawmidiwatch(void)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+bool
+rawmidichanged(int fd)
+{
+	return false;
+}
+#endif
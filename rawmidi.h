@@ -0,0 +1,8 @@
+#ifndef RAWMIDI_H
+#define RAWMIDI_H
+
+int rawmidiopen(const char *port, bool (*match)(const char *), char *name, size_t namelen);
+int rawmidiwatch(void);
+bool rawmidichanged(int fd);
+
+#endif
@@ -0,0 +1,113 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "intpack.h"
+#include "record.h"
+
+/* pcapng link type reserved for private use */
+#define LINKTYPE_USER0 147
+
+static FILE *recfp;
+static bool pcapng;
+
+static void
+writeblock(unsigned long type, const void *hdr, size_t hdrlen, const void *buf, size_t len)
+{
+	static const unsigned char pad[4];
+	unsigned char word[4];
+	size_t padlen, blocklen;
+
+	padlen = -len & 3;
+	blocklen = 12 + hdrlen + len + padlen;
+	putle32(word, type);
+	fwrite(word, 1, 4, recfp);
+	putle32(word, blocklen);
+	fwrite(word, 1, 4, recfp);
+	fwrite(hdr, 1, hdrlen, recfp);
+	fwrite(buf, 1, len, recfp);
+	fwrite(pad, 1, padlen, recfp);
+	putle32(word, blocklen);
+	fwrite(word, 1, 4, recfp);
+}
+
+/* records are written as pcapng if path ends in .pcapng */
+int
+recopen(const char *path)
+{
+	static const unsigned char magic[8] = "OSCMIXRC";
+	unsigned char hdr[20], *pos;
+	size_t len;
+
+	recfp = fopen(path, "wb");
+	if (!recfp)
+		return -1;
+	len = strlen(path);
+	pcapng = len >= 7 && strcmp(path + len - 7, ".pcapng") == 0;
+	if (pcapng) {
+		/* section header */
+		pos = putle32(hdr, 0x1A2B3C4D);
+		pos = putle16(pos, 1);
+		pos = putle16(pos, 0);
+		pos = putle64(pos, -1);
+		writeblock(0x0A0D0D0A, hdr, pos - hdr, NULL, 0);
+		/* interface description with nanosecond timestamps */
+		pos = putle16(hdr, LINKTYPE_USER0);
+		pos = putle16(pos, 0);
+		pos = putle32(pos, 0);
+		pos = putle16(pos, 9);
+		pos = putle16(pos, 1);
+		*pos++ = 9, *pos++ = 0, *pos++ = 0, *pos++ = 0;
+		pos = putle32(pos, 0);
+		writeblock(1, hdr, pos - hdr, NULL, 0);
+	} else {
+		fwrite(magic, 1, sizeof magic, recfp);
+		putle32(hdr, 1);
+		fwrite(hdr, 1, 4, recfp);
+	}
+	return ferror(recfp) ? -1 : 0;
+}
+
+/* appends a message with the current monotonic time */
+void
+recwrite(int type, int dev, const void *buf, size_t len)
+{
+	struct timespec ts;
+	uint_least64_t ns;
+	unsigned char hdr[24], *pos;
+
+	if (!recfp)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ns = (uint_least64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	if (pcapng) {
+		/* enhanced packet, prefixed with the type and device */
+		pos = putle32(hdr, 0);
+		pos = putle32(pos, ns >> 32);
+		pos = putle32(pos, ns & 0xffffffff);
+		pos = putle32(pos, len + 4);
+		pos = putle32(pos, len + 4);
+		*pos++ = type;
+		*pos++ = dev;
+		pos = putle16(pos, 0);
+		writeblock(6, hdr, pos - hdr, buf, len);
+	} else {
+		pos = putle64(hdr, ns);
+		*pos++ = type;
+		*pos++ = dev;
+		pos = putle16(pos, 0);
+		pos = putle32(pos, len);
+		fwrite(hdr, 1, pos - hdr, recfp);
+		fwrite(buf, 1, len, recfp);
+	}
+}
+
+void
+recflush(void)
+{
+	if (recfp)
+		fflush(recfp);
+}
@@ -0,0 +1,23 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+enum {
+	REC_MIDIIN,   /* SysEx message from a device */
+	REC_MIDIOUT,  /* SysEx message to a device */
+	REC_OSCIN,
+	REC_OSCOUT,
+	REC_DEVICE,   /* MIDI port name of a new device */
+	REC_TIMER,    /* timer tick; one byte, whether levels were requested */
+	REC_CONNECT,  /* one byte, whether the device is connected */
+	REC_LOST,     /* input from the device was dropped */
+	REC_OSCREPAIR,  /* bundle resent for a /nack */
+};
+
+/* size of the header of each record in the native format */
+#define RECHDRLEN 16
+
+int recopen(const char *path);
+void recwrite(int type, int dev, const void *buf, size_t len);
+void recflush(void);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SNAPMAGIC "OSCMIXSN"
+#define SNAPVERSION 1
+
+/* number of device registers in the image */
+#define SNAPREGS 0x8000
+
+struct snapmix {
+	float db;     /* -inf if muted */
+	int32_t pan;  /* -100 (left) to 100 (right) */
+};
+
+/* the regions follow the header, at the given byte offsets */
+struct snaphdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t size;
+	char device[32];
+	uint32_t inputslen;
+	uint32_t outputslen;
+	uint32_t regsoff;   /* int32_t[SNAPREGS], -1 if unknown */
+	uint32_t namesoff;  /* char[inputslen + outputslen][12], inputs then outputs */
+	uint32_t mixoff;    /* struct snapmix[outputslen][inputslen + outputslen] */
+	/* odd while being updated; changes with every update */
+	_Atomic uint32_t generation;
+	struct {
+		int32_t status;
+		int32_t position;
+		int32_t time;
+		int32_t usbload;
+		float totalspace;
+		float freespace;
+		int32_t fileslen;
+		int32_t file;
+	} durec;
+};
+
+/* waits for a consistent state and returns its generation */
+static inline uint32_t
+snapbegin(const struct snaphdr *hdr)
+{
+	uint32_t gen;
+
+	while ((gen = atomic_load_explicit((_Atomic uint32_t *)&hdr->generation, memory_order_acquire)) & 1)
+		;
+	return gen;
+}
+
+/* whether anything read since snapbegin returned gen may be inconsistent */
+static inline bool
+snapretry(const struct snaphdr *hdr, uint32_t gen)
+{
+	atomic_thread_fence(memory_order_acquire);
+	return atomic_load_explicit((_Atomic uint32_t *)&hdr->generation, memory_order_relaxed) != gen;
+}
+
+#endif
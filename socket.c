@@ -2,23 +2,309 @@
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ifaddrs.h>
 #include <netdb.h>
+#include <net/if.h>
 #include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <unistd.h>
 #include "socket.h"
 #include "util.h"
 
-int
-sockopen(char *addr, int passive)
+/* control echoes are small and latency matters more than throughput */
+void
+socknodelay(int sock)
+{
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+}
+
+static int
+tcpopen(char *addr, char *port, int passive)
+{
+	struct addrinfo hint;
+	struct addrinfo *ais, *ai;
+	int err, sock, flags;
+
+	memset(&hint, 0, sizeof hint);
+	hint.ai_flags = passive ? AI_PASSIVE : 0;
+	hint.ai_family = AF_UNSPEC;
+	hint.ai_socktype = SOCK_STREAM;
+	hint.ai_protocol = IPPROTO_TCP;
+	err = getaddrinfo(addr, port, &hint, &ais);
+	if (err != 0)
+		fatal("getaddrinfo: %s", gai_strerror(err));
+	sock = -1;
+	for (ai = ais; ai; ai = ai->ai_next) {
+		sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (sock < 0)
+			continue;
+		if (passive) {
+			if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int)) != 0)
+				fatal("setsockopt SO_REUSEADDR:");
+			if (bind(sock, ai->ai_addr, ai->ai_addrlen) == 0 && listen(sock, SOMAXCONN) == 0)
+				break;
+		} else if (connect(sock, ai->ai_addr, ai->ai_addrlen) == 0) {
+			break;
+		}
+		close(sock);
+		sock = -1;
+	}
+	freeaddrinfo(ais);
+	if (sock == -1)
+		fatal(passive ? "bind:" : "connect:");
+	if (!passive)
+		socknodelay(sock);
+	/* connections are written to from the poll loop, and accept must not block */
+	flags = fcntl(sock, F_GETFL);
+	if (flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) != 0)
+		fatal("fcntl:");
+	return sock;
+}
+
+/* returns the address of an IPv4 interface, given by name or address */
+static struct in_addr
+ifaddr4(const char *name)
+{
+	struct ifaddrs *ifas, *ifa;
+	struct in_addr in;
+
+	if (inet_pton(AF_INET, name, &in) == 1)
+		return in;
+	if (getifaddrs(&ifas) != 0)
+		fatal("getifaddrs:");
+	for (ifa = ifas; ifa; ifa = ifa->ifa_next) {
+		if (ifa->ifa_addr && ifa->ifa_addr->sa_family == AF_INET && strcmp(ifa->ifa_name, name) == 0)
+			break;
+	}
+	if (!ifa)
+		fatal("interface '%s' has no IPv4 address", name);
+	in = ((struct sockaddr_in *)ifa->ifa_addr)->sin_addr;
+	freeifaddrs(ifas);
+	return in;
+}
+
+/* joins the group of a receive address, or sets up sending to it; returns whether it is multicast */
+static bool
+joingroup(int sock, const struct addrinfo *ai, int passive, int ttl, const char *ifname)
+{
+	struct ip_mreq mreq;
+	struct ipv6_mreq mreq6;
+	struct in_addr iface;
+	unsigned index;
+
+	switch (ai->ai_family) {
+	case AF_INET:
+		mreq.imr_multiaddr = ((struct sockaddr_in *)ai->ai_addr)->sin_addr;
+		if (!IN_MULTICAST(ntohl(mreq.imr_multiaddr.s_addr)))
+			return false;
+		iface.s_addr = htonl(INADDR_ANY);
+		if (ifname)
+			iface = ifaddr4(ifname);
+		if (passive) {
+			mreq.imr_interface = iface;
+			if (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof mreq) != 0)
+				fatal("setsockopt IP_ADD_MEMBERSHIP:");
+			break;
+		}
+		if (ifname && setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof iface) != 0)
+			fatal("setsockopt IP_MULTICAST_IF:");
+		if (ttl != -1 && setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &(unsigned char){ttl}, 1) != 0)
+			fatal("setsockopt IP_MULTICAST_TTL:");
+		break;
+	case AF_INET6:
+		mreq6.ipv6mr_multiaddr = ((struct sockaddr_in6 *)ai->ai_addr)->sin6_addr;
+		if (!IN6_IS_ADDR_MULTICAST(&mreq6.ipv6mr_multiaddr))
+			return false;
+		index = 0;
+		if (ifname && (index = if_nametoindex(ifname)) == 0)
+			fatal("unknown interface '%s'", ifname);
+		/* link-local groups need the interface as their scope */
+		if (((struct sockaddr_in6 *)ai->ai_addr)->sin6_scope_id == 0)
+			((struct sockaddr_in6 *)ai->ai_addr)->sin6_scope_id = index;
+		if (passive) {
+			mreq6.ipv6mr_interface = index;
+			if (setsockopt(sock, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mreq6, sizeof mreq6) != 0)
+				fatal("setsockopt IPV6_JOIN_GROUP:");
+			break;
+		}
+		if (ifname && setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_IF, &index, sizeof index) != 0)
+			fatal("setsockopt IPV6_MULTICAST_IF:");
+		if (ttl != -1 && setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &ttl, sizeof ttl) != 0)
+			fatal("setsockopt IPV6_MULTICAST_HOPS:");
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+static int
+udpopen(char *addr, char *port, char *opt, int passive)
 {
 	struct addrinfo hint;
-	char *type, *port, *sep, *end;
 	struct addrinfo *ais, *ai;
-	int err, sock;
+	const char *ifname;
+	char *tok, *val, *end;
+	int err, sock, ttl;
+	bool multicast;
+
+	/* options are a comma-separated list of ttl=hops and if=interface */
+	ttl = -1;
+	ifname = NULL;
+	for (tok = opt ? strtok_r(opt, ",", &end) : NULL; tok; tok = strtok_r(NULL, ",", &end)) {
+		if (strncmp(tok, "ttl=", 4) == 0 && !passive) {
+			ttl = strtol(tok + 4, &val, 10);
+			if (val == tok + 4 || *val || ttl < 0 || ttl > 255)
+				fatal("invalid udp ttl");
+		} else if (strncmp(tok, "if=", 3) == 0 && tok[3]) {
+			ifname = tok + 3;
+		} else {
+			fatal("unsupported udp option '%s'", tok);
+		}
+	}
+	memset(&hint, 0, sizeof hint);
+	hint.ai_flags = passive ? AI_PASSIVE : 0;
+	hint.ai_family = AF_UNSPEC;
+	hint.ai_socktype = SOCK_DGRAM;
+	hint.ai_protocol = IPPROTO_UDP;
+	err = getaddrinfo(addr, port, &hint, &ais);
+	if (err != 0)
+		fatal("getaddrinfo: %s", gai_strerror(err));
+	sock = -1;
+	for (ai = ais; ai; ai = ai->ai_next) {
+		sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (sock < 0)
+			continue;
+		multicast = joingroup(sock, ai, passive, ttl, ifname);
+		if (!multicast && opt)
+			fatal("udp options need a multicast address");
+		if (passive) {
+			if (multicast && setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int)) != 0)
+				fatal("setsockopt SO_REUSEADDR:");
+			if (bind(sock, ai->ai_addr, ai->ai_addrlen) == 0)
+				break;
+		} else if (connect(sock, ai->ai_addr, ai->ai_addrlen) == 0) {
+			break;
+		}
+		close(sock);
+		sock = -1;
+	}
+	freeaddrinfo(ais);
+	if (sock == -1)
+		fatal(passive ? "bind:" : "connect:");
+	return sock;
+}
+
+/* whether a connected datagram socket sends to a multicast group */
+bool
+sockmulticast(int sock)
+{
+	struct sockaddr_storage sa;
+	socklen_t len;
+
+	len = sizeof sa;
+	if (getpeername(sock, (struct sockaddr *)&sa, &len) != 0)
+		return false;
+	switch (sa.ss_family) {
+	case AF_INET:
+		return IN_MULTICAST(ntohl(((struct sockaddr_in *)&sa)->sin_addr.s_addr));
+	case AF_INET6:
+		return IN6_IS_ADDR_MULTICAST(&((struct sockaddr_in6 *)&sa)->sin6_addr);
+	}
+	return false;
+}
+
+static int
+unixopen(char *path, char *opt, int passive, int *framing)
+{
+	struct sockaddr_un sa;
+	struct stat st;
+	int type, sock, flags;
+
+	if (!opt || strcmp(opt, "seqpacket") == 0)
+		type = SOCK_SEQPACKET;
+	else if (strcmp(opt, "dgram") == 0)
+		type = SOCK_DGRAM;
+	else
+		fatal("unsupported unix socket type '%s'", opt);
+	if (type == SOCK_SEQPACKET && !framing)
+		fatal("unix seqpacket address is not supported");
+	if (!path || strlen(path) >= sizeof sa.sun_path)
+		fatal("invalid unix socket path");
+	memset(&sa, 0, sizeof sa);
+	sa.sun_family = AF_UNIX;
+	strcpy(sa.sun_path, path);
+	sock = socket(AF_UNIX, type, 0);
+	if (sock < 0)
+		fatal("socket:");
+	if (passive) {
+		/* replace the socket left behind by an earlier run */
+		if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+			unlink(path);
+		if (bind(sock, (struct sockaddr *)&sa, sizeof sa) != 0)
+			fatal("bind %s:", path);
+		if (type == SOCK_SEQPACKET && listen(sock, SOMAXCONN) != 0)
+			fatal("listen %s:", path);
+	} else if (connect(sock, (struct sockaddr *)&sa, sizeof sa) != 0) {
+		fatal("connect %s:", path);
+	}
+	if (type == SOCK_SEQPACKET) {
+		*framing = FRAME_PACKET;
+		flags = fcntl(sock, F_GETFL);
+		if (flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) != 0)
+			fatal("fcntl:");
+	}
+	return sock;
+}
+
+/* local peers must run as the same user, or as root */
+bool
+sockpeerok(int sock)
+{
+	struct sockaddr_storage sa;
+	socklen_t len;
+	uid_t uid;
+
+	len = sizeof sa;
+	if (getsockname(sock, (struct sockaddr *)&sa, &len) != 0)
+		return false;
+	if (sa.ss_family != AF_UNIX)
+		return true;
+#ifdef __linux__
+	{
+		struct ucred cred;
+
+		len = sizeof cred;
+		if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0)
+			return false;
+		uid = cred.uid;
+	}
+#else
+	{
+		gid_t gid;
+
+		if (getpeereid(sock, &uid, &gid) != 0)
+			return false;
+	}
+#endif
+	return uid == 0 || uid == geteuid();
+}
+
+int
+sockopen(char *addr, int passive, int *framing)
+{
+	char *type, *port, *opt, *sep, *end;
+	int sock;
 	long val;
 
+	if (framing)
+		*framing = FRAME_NONE;
 	val = strtol(addr, &end, 0);
 	if (*addr && !*end && val >= 0 && val < INT_MAX)
 		return val;
@@ -26,6 +312,7 @@ sockopen(char *addr, int passive)
 	type = addr;
 	addr = NULL;
 	port = NULL;
+	opt = NULL;
 	sep = strchr(type, '!');
 	if (sep) {
 		*sep = '\0';
@@ -34,6 +321,11 @@ sockopen(char *addr, int passive)
 		if (sep) {
 			*sep = '\0';
 			port = sep + 1;
+			sep = strchr(port, '!');
+			if (sep) {
+				*sep = '\0';
+				opt = sep + 1;
+			}
 			if (*port == '\0')
 				port = NULL;
 		}
@@ -42,59 +334,28 @@ sockopen(char *addr, int passive)
 	}
 	sock = -1;
 	if (strcmp(type, "udp") == 0) {
-		memset(&hint, 0, sizeof hint);
-		hint.ai_flags = passive ? AI_PASSIVE : 0;
-		hint.ai_family = AF_UNSPEC;
-		hint.ai_socktype = SOCK_DGRAM;
-		hint.ai_protocol = IPPROTO_UDP;
-		err = getaddrinfo(addr, port, &hint, &ais);
-		if (err != 0)
-			fatal("getaddrinfo: %s", gai_strerror(err));
-		for (ai = ais; ai; ai = ai->ai_next) {
-			sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
-			if (sock >= 0) {
-				if (passive) {
-					union {
-						struct ip_mreq v4;
-						struct ipv6_mreq v6;
-					} mreq;
-					bool multicast;
-
-					switch (ai->ai_family) {
-					case AF_INET:
-						mreq.v4.imr_multiaddr = ((struct sockaddr_in *)ai->ai_addr)->sin_addr;
-						if ((((unsigned char *)&mreq.v4.imr_multiaddr)[0] & 0xf0) == 0xe0) {
-							mreq.v4.imr_interface.s_addr = INADDR_ANY;
-							if (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq.v4, sizeof mreq.v4) != 0)
-								fatal("setsockopt IP_ADD_MEMBERSHIP:");
-							multicast = true;
-						}
-						break;
-					case AF_INET6:
-						mreq.v6.ipv6mr_multiaddr = ((struct sockaddr_in6 *)addr)->sin6_addr;
-						if (mreq.v6.ipv6mr_multiaddr.s6_addr[0] == 0xff) {
-							mreq.v6.ipv6mr_interface = 0;
-							if (setsockopt(sock, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mreq.v6, sizeof mreq.v6) != 0)
-								fatal("setsockopt IPV6_ADD_MEMBERSHIP:");
-							multicast = true;
-						}
-						break;
-					}
-
-					if (multicast && setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int)) != 0)
-						fatal("setsockopt SO_REUSEADDR:");
-					if (bind(sock, ai->ai_addr, ai->ai_addrlen) == 0)
-						break;
-				} else if (connect(sock, ai->ai_addr, ai->ai_addrlen) == 0) {
-					break;
-				}
-				close(sock);
-				sock = -1;
-			}
-		}
-		freeaddrinfo(ais);
-		if (sock == -1)
-			fatal("connect:");
+		sock = udpopen(addr, port, opt, passive);
+	} else if (strcmp(type, "tcp") == 0) {
+		if (!framing)
+			fatal("stream address '%s' is not supported", type);
+		if (!opt || strcmp(opt, "slip") == 0)
+			*framing = FRAME_SLIP;
+		else if (strcmp(opt, "len") == 0)
+			*framing = FRAME_LEN;
+		else
+			fatal("unsupported tcp framing '%s'", opt);
+		sock = tcpopen(addr, port, passive);
+	} else if (strcmp(type, "ws") == 0) {
+		if (!framing || !passive)
+			fatal("WebSocket address must be a receive address");
+		if (opt)
+			fatal("unsupported ws option '%s'", opt);
+		*framing = FRAME_WS;
+		sock = tcpopen(addr, port, passive);
+	} else if (strcmp(type, "unix") == 0) {
+		if (opt)
+			fatal("unsupported unix option '%s'", opt);
+		sock = unixopen(addr, port, passive, framing);
 	} else {
 		fatal("unsupported address type '%s'", type);
 	}
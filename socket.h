@@ -1,6 +1,20 @@
 #ifndef SOCKET_H
 #define SOCKET_H
 
-int sockopen(char *addr, int passive);
+#include <stdbool.h>
+
+/* how OSC packets are delimited on a socket */
+enum framing {
+	FRAME_NONE,    /* datagram socket */
+	FRAME_SLIP,    /* OSC 1.1 double-END SLIP */
+	FRAME_LEN,     /* OSC 1.0 big-endian int32 size prefix */
+	FRAME_PACKET,  /* unix seqpacket socket, one packet per message */
+	FRAME_WS,      /* WebSocket binary messages, after an HTTP upgrade */
+};
+
+int sockopen(char *addr, int passive, int *framing);
+void socknodelay(int sock);
+bool sockpeerok(int sock);
+bool sockmulticast(int sock);
 
 #endif
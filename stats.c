@@ -0,0 +1,92 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "stats.h"
+
+struct stats stats;
+
+const char *const statnames[NUMSTATS] = {
+	[STAT_SYSEXIN] = "sysexin",
+	[STAT_SYSEXOUT] = "sysexout",
+	[STAT_SYSEXQUEUED] = "sysexqueued",
+	[STAT_SYSEXLARGE] = "sysexlarge",
+	[STAT_OSCIN] = "oscin",
+	[STAT_OSCOUT] = "oscout",
+	[STAT_OSCERROR] = "oscerror",
+	[STAT_OSCNACK] = "oscnack",
+	[STAT_OSCREPAIR] = "oscrepair",
+};
+
+const char *const timenames[NUMTIMES] = {
+	[TIME_SYSEX] = "sysex",
+	[TIME_OSC] = "osc",
+	[TIME_TIMER] = "timer",
+};
+
+uint_least64_t
+stattime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint_least64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* records the time since start in the histogram */
+void
+stattimed(int time, uint_least64_t start)
+{
+	uint_least64_t ns;
+	int bucket;
+
+	ns = stattime() - start;
+	for (bucket = 0; bucket < TIMEBUCKETS - 1 && ns >> bucket; ++bucket)
+		;
+	++stats.time[time].buckets[bucket];
+	++stats.time[time].count;
+	stats.time[time].total += ns;
+	if (ns > stats.time[time].max)
+		stats.time[time].max = ns;
+}
+
+/* returns the upper bound of the bucket holding the percentile */
+uint_least64_t
+statpercentile(int time, double p)
+{
+	uint_least64_t n, rank;
+	int bucket;
+
+	if (stats.time[time].count == 0)
+		return 0;
+	rank = stats.time[time].count * p;
+	n = 0;
+	for (bucket = 0; bucket < TIMEBUCKETS - 1; ++bucket) {
+		n += stats.time[time].buckets[bucket];
+		if (n > rank)
+			break;
+	}
+	return (uint_least64_t)1 << bucket;
+}
+
+void
+statdump(FILE *fp)
+{
+	int i;
+
+	for (i = 0; i < NUMSTATS; ++i) {
+		fprintf(fp, "%s %llu %llu\n", statnames[i],
+			(unsigned long long)stats.count[i].count,
+			(unsigned long long)stats.count[i].bytes);
+	}
+	for (i = 0; i < NUMTIMES; ++i) {
+		fprintf(fp, "time %s %llu avg %llu p50 %llu p99 %llu p999 %llu max %llu\n", timenames[i],
+			(unsigned long long)stats.time[i].count,
+			(unsigned long long)(stats.time[i].count ? stats.time[i].total / stats.time[i].count : 0),
+			(unsigned long long)statpercentile(i, 0.5),
+			(unsigned long long)statpercentile(i, 0.99),
+			(unsigned long long)statpercentile(i, 0.999),
+			(unsigned long long)stats.time[i].max);
+	}
+	fflush(fp);
+}
@@ -0,0 +1,56 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+enum {
+	STAT_SYSEXIN,     /* SysEx messages from devices */
+	STAT_SYSEXOUT,    /* SysEx messages to devices */
+	STAT_SYSEXQUEUED, /* device writes that had to wait for POLLOUT */
+	STAT_SYSEXLARGE,  /* input dropped for overflowing the read buffer */
+	STAT_OSCIN,
+	STAT_OSCOUT,
+	STAT_OSCERROR,    /* OSC writes that failed, such as with ENOBUFS */
+	STAT_OSCNACK,     /* /nack requests from multicast receivers */
+	STAT_OSCREPAIR,   /* bundles resent for them */
+	NUMSTATS,
+};
+
+enum {
+	TIME_SYSEX,  /* handlesysex */
+	TIME_OSC,    /* handleosc */
+	TIME_TIMER,  /* handletimer */
+	NUMTIMES,
+};
+
+/* bucket n counts times below 2^n ns */
+#define TIMEBUCKETS 32
+
+struct stats {
+	struct {
+		uint_least64_t count, bytes;
+	} count[NUMSTATS];
+	struct {
+		uint_least64_t count, total, max;
+		uint_least64_t buckets[TIMEBUCKETS];
+	} time[NUMTIMES];
+};
+
+extern struct stats stats;
+extern const char *const statnames[NUMSTATS];
+extern const char *const timenames[NUMTIMES];
+
+static inline void
+statcount(int stat, uint_least64_t bytes)
+{
+	++stats.count[stat].count;
+	stats.count[stat].bytes += bytes;
+}
+
+uint_least64_t stattime(void);
+void stattimed(int time, uint_least64_t start);
+uint_least64_t statpercentile(int time, double p);
+void statdump(FILE *fp);
+
+#endif
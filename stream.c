@@ -0,0 +1,659 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#include "http.h"
+#include "httpfile.h"
+#include "intpack.h"
+#include "socket.h"
+#include "stream.h"
+#include "util.h"
+#include "ws.h"
+
+#define LEN(a) (sizeof (a) / sizeof *(a))
+
+enum {
+	SLIP_END = 0xc0,
+	SLIP_ESC = 0xdb,
+	SLIP_ESCEND = 0xdc,
+	SLIP_ESCESC = 0xdd,
+};
+
+struct stream *
+streamopen(int fd, int framing)
+{
+	struct stream *s;
+
+	s = calloc(1, sizeof *s);
+	if (!s)
+		fatal("calloc:");
+	s->fd = fd;
+	s->framing = framing;
+	s->filefd = -1;
+	return s;
+}
+
+void
+streamclose(struct stream *s)
+{
+	close(s->fd);
+	if (s->filefd >= 0)
+		close(s->filefd);
+	wsdeflatefree(s->deflate);
+	free(s->wbuf);
+	free(s);
+}
+
+/* decodes a SLIP frame in place, returning its length */
+static size_t
+slipdecode(unsigned char *buf, size_t len)
+{
+	unsigned char *src, *dst, *end;
+
+	dst = buf;
+	end = buf + len;
+	for (src = buf; src < end; ++src) {
+		if (*src == SLIP_ESC && src + 1 < end) {
+			++src;
+			*dst++ = *src == SLIP_ESCEND ? SLIP_END : *src == SLIP_ESCESC ? SLIP_ESC : *src;
+		} else {
+			*dst++ = *src;
+		}
+	}
+	return dst - buf;
+}
+
+/* returns room for max more bytes of output, or NULL on overflow */
+static unsigned char *
+reserve(struct stream *s, size_t max)
+{
+	unsigned char *wbuf;
+	size_t cap;
+
+	if (max > s->wbufcap - s->wbuflen) {
+		if (s->wbuflen + max > STREAMMAX) {
+			fprintf(stderr, "OSC output queue overflow; closing connection\n");
+			s->dead = true;
+			return NULL;
+		}
+		cap = s->wbufcap ? s->wbufcap * 2 : 8192;
+		while (cap - s->wbuflen < max)
+			cap *= 2;
+		wbuf = realloc(s->wbuf, cap);
+		if (!wbuf)
+			fatal("realloc:");
+		s->wbuf = wbuf;
+		s->wbufcap = cap;
+	}
+	return s->wbuf + s->wbuflen;
+}
+
+/* queues the output up to pos, and writes as much as the socket takes */
+static void
+commit(struct stream *s, unsigned char *pos)
+{
+	bool queued;
+
+	queued = s->wbuflen > 0;
+	s->wbuflen = pos - s->wbuf;
+	/* otherwise, the poll loop flushes when the socket is writable */
+	if (!queued)
+		streamflush(s);
+}
+
+/* returns whether a failed send can be retried once the socket is writable */
+static bool
+sendagain(struct stream *s)
+{
+	if (errno == EAGAIN || errno == EINTR)
+		return true;
+	if (errno != EPIPE && errno != ECONNRESET)
+		perror("send");
+	s->dead = true;
+	return false;
+}
+
+static void
+wswrite(struct stream *s, int op, const unsigned char *buf, size_t len)
+{
+	unsigned char hdr[WS_HDRMAX], *pos;
+	struct iovec iov[2];
+	struct msghdr msg;
+	size_t hdrlen, off;
+	ssize_t ret;
+
+	hdrlen = wsframehdr(hdr, op, len);
+	off = 0;
+	/* with nothing queued, the frame is sent without copying it first */
+	if (s->wbuflen == 0) {
+		iov[0].iov_base = hdr;
+		iov[0].iov_len = hdrlen;
+		iov[1].iov_base = (void *)buf;
+		iov[1].iov_len = len;
+		memset(&msg, 0, sizeof msg);
+		msg.msg_iov = iov;
+		msg.msg_iovlen = 2;
+		ret = sendmsg(s->fd, &msg, MSG_NOSIGNAL);
+		if (ret < 0) {
+			if (!sendagain(s))
+				return;
+			ret = 0;
+		}
+		if (ret == hdrlen + len)
+			return;
+		off = ret;
+	}
+	pos = reserve(s, hdrlen + len - off);
+	if (!pos)
+		return;
+	if (off < hdrlen) {
+		memcpy(pos, hdr + off, hdrlen - off);
+		pos += hdrlen - off;
+		off = hdrlen;
+	}
+	memcpy(pos, buf + (off - hdrlen), len - (off - hdrlen));
+	pos += len - (off - hdrlen);
+	/* the poll loop flushes the rest when the socket is writable */
+	s->wbuflen = pos - s->wbuf;
+}
+
+static void
+wsclose(struct stream *s, int code)
+{
+	unsigned char buf[2];
+
+	putbe16(buf, code);
+	wswrite(s, WS_CLOSE, buf, sizeof buf);
+	s->dead = true;
+}
+
+/* queues a response with only a status line */
+static void
+httperror(struct stream *s, int code, const char *text)
+{
+	char buf[256];
+	unsigned char *pos;
+	FILE *fp;
+	long len;
+
+	fp = fmemopen(buf, sizeof buf, "w");
+	if (!fp)
+		fatal("fmemopen:");
+	http_error(fp, code, text, NULL, 0);
+	len = ftell(fp);
+	fclose(fp);
+	pos = reserve(s, len);
+	if (!pos)
+		return;
+	memcpy(pos, buf, len);
+	commit(s, pos + len);
+}
+
+/* answers a GET for a file, queuing a small body with the header */
+static void
+servefile(struct stream *s, struct wsrequest *req)
+{
+	char hdr[512];
+	unsigned char *pos;
+	off_t size;
+	ssize_t ret;
+	int len, fd;
+	bool small;
+
+	len = httpfile(req->uri, req->encodings, req->etags, hdr, sizeof hdr, &fd, &size);
+	if (len < 0) {
+		httperror(s, 404, "Not Found");
+		return;
+	}
+	small = fd >= 0 && size <= HTTPFILESMALL;
+	pos = reserve(s, len + (small ? size : 0));
+	if (!pos) {
+		if (fd >= 0)
+			close(fd);
+		return;
+	}
+	memcpy(pos, hdr, len);
+	pos += len;
+	if (small) {
+		ret = pread(fd, pos, size, 0);
+		close(fd);
+		if (ret != size) {
+			if (ret < 0)
+				perror("read");
+			s->dead = true;
+			return;
+		}
+		pos += size;
+	} else if (fd >= 0) {
+		/* the rest is sent from the file once the header is out */
+		s->filefd = fd;
+		s->fileoff = 0;
+		s->filelen = size;
+	}
+	commit(s, pos);
+}
+
+/* answers the HTTP request at the start of rbuf once it is complete, and returns whether it was */
+static bool
+httprequest(struct stream *s)
+{
+	struct wsrequest req = {0};
+	char *line, *next, *end, buf[512];
+	unsigned char *pos;
+	size_t len;
+	int ret;
+
+	if (s->rbuflen == sizeof s->rbuf)
+		goto fail;
+	s->rbuf[s->rbuflen] = '\0';
+	end = strstr((char *)s->rbuf, "\r\n\r\n");
+	if (!end)
+		return false;
+	end += 4;
+	ret = 0;
+	for (line = (char *)s->rbuf; ret == 0 && line < end; line = next) {
+		next = strstr(line, "\r\n") + 2;
+		ret = wsrequestline(&req, line, next - line);
+	}
+	if (ret < 0)
+		goto fail;
+	/* consumed first, since the answer may go on to the next request once it is sent */
+	len = end - (char *)s->rbuf;
+	s->rbuflen -= len;
+	memmove(s->rbuf, s->rbuf + len, s->rbuflen);
+	/* with a directory to serve, anything but an upgrade is a file */
+	if (httpfiledir >= 0 && !req.upgrade && !req.websocket) {
+		servefile(s, &req);
+		return true;
+	}
+	ret = wsresponse(&req, buf, sizeof buf);
+	if (ret < 0)
+		goto fail;
+	pos = reserve(s, ret);
+	if (!pos)
+		return false;
+	memcpy(pos, buf, ret);
+	s->upgraded = true;
+	if (req.deflate)
+		s->deflate = wsdeflatenew(&req);
+	commit(s, pos + ret);
+	return true;
+
+fail:
+	httperror(s, 400, "Bad Request");
+	s->dead = true;
+	return false;
+}
+
+/* answers requests in rbuf until the connection is upgraded, or a file is being sent */
+static void
+httpserve(struct stream *s)
+{
+	while (!s->upgraded && s->filefd < 0 && !s->dead && s->rbuflen > 0 && httprequest(s))
+		;
+}
+
+/* handles the complete frames from pos, and returns the end of the last */
+static unsigned char *
+wsread(struct stream *s, unsigned char *pos, unsigned char *end, void (*handle)(const unsigned char *, size_t))
+{
+	static unsigned char inflated[sizeof s->rbuf];
+	struct wsframe f;
+	unsigned char *data;
+	size_t hdrlen;
+	long len;
+
+	while ((hdrlen = wsframeparse(pos, end - pos, &f)) > 0) {
+		/* clients must mask their frames, and only compress the first of a message */
+		if (!f.masked || (f.op & 0x8 && (!f.fin || f.len >= 126))
+		 || (f.rsv && (f.rsv != WS_RSV1 || !s->deflate || f.op == WS_CONT || f.op & 0x8))) {
+			wsclose(s, 1002);
+			break;
+		}
+		if (f.len > sizeof s->rbuf - s->msglen - hdrlen) {
+			fprintf(stderr, "OSC packet too large; closing connection\n");
+			wsclose(s, 1009);
+			break;
+		}
+		if (f.len > end - pos - hdrlen)
+			break;
+		data = pos + hdrlen;
+		pos = data + f.len;
+		wsunmask(data, f.len, f.key);
+		switch (f.op) {
+		case WS_CONT:
+		case WS_TEXT:
+		case WS_BINARY:
+			if (f.op != WS_CONT)
+				s->msgdeflated = f.rsv & WS_RSV1;
+			/* fragments are collected at the start of rbuf */
+			memmove(s->rbuf + s->msglen, data, f.len);
+			s->msglen += f.len;
+			if (!f.fin)
+				break;
+			if (s->msgdeflated) {
+				len = wsinflate(s->deflate, s->rbuf, s->msglen, inflated, sizeof inflated);
+				if (len < 0) {
+					fprintf(stderr, "invalid or too large compressed message; closing connection\n");
+					wsclose(s, 1009);
+					return pos;
+				}
+				handle(inflated, len);
+			} else {
+				handle(s->rbuf, s->msglen);
+			}
+			s->msglen = 0;
+			break;
+		case WS_PING:
+			wswrite(s, WS_PONG, data, f.len);
+			break;
+		case WS_PONG:
+			break;
+		case WS_CLOSE:
+			wswrite(s, WS_CLOSE, data, f.len > 2 ? 2 : f.len);
+			s->dead = true;
+			return pos;
+		default:
+			wsclose(s, 1002);
+			return pos;
+		}
+	}
+	return pos;
+}
+
+/* reads what is available and calls handle for each complete packet */
+void
+streamread(struct stream *s, void (*handle)(const unsigned char *, size_t))
+{
+	unsigned char *pos, *end, *next;
+	size_t len;
+	ssize_t ret;
+
+	ret = recv(s->fd, s->rbuf + s->rbuflen, sizeof s->rbuf - s->rbuflen, 0);
+	if (ret <= 0) {
+		if (ret < 0 && (errno == EAGAIN || errno == EINTR))
+			return;
+		if (ret < 0 && errno != ECONNRESET)
+			perror("read");
+		s->dead = true;
+		return;
+	}
+	s->rbuflen += ret;
+	pos = s->rbuf + s->msglen;
+	end = s->rbuf + s->rbuflen;
+	switch (s->framing) {
+	case FRAME_WS:
+		if (!s->upgraded) {
+			httpserve(s);
+			if (!s->upgraded)
+				return;
+			pos = s->rbuf;
+			end = s->rbuf + s->rbuflen;
+		}
+		pos = wsread(s, pos, end, handle);
+		if (s->dead)
+			return;
+		break;
+	case FRAME_PACKET:
+		handle(pos, s->rbuflen);
+		pos = end;
+		break;
+	case FRAME_SLIP:
+		while ((next = memchr(pos, SLIP_END, end - pos))) {
+			len = slipdecode(pos, next - pos);
+			/* empty frames come from the leading END of each packet */
+			if (len > 0)
+				handle(pos, len);
+			pos = next + 1;
+		}
+		break;
+	case FRAME_LEN:
+		while (end - pos >= 4) {
+			len = getbe32(pos);
+			if (len > sizeof s->rbuf - 4) {
+				fprintf(stderr, "OSC packet too large; closing connection\n");
+				s->dead = true;
+				return;
+			}
+			if (end - pos - 4 < len)
+				break;
+			handle(pos + 4, len);
+			pos += 4 + len;
+		}
+		break;
+	}
+	if (pos == s->rbuf + s->msglen && s->rbuflen == sizeof s->rbuf) {
+		fprintf(stderr, "OSC packet too large; closing connection\n");
+		s->dead = true;
+		return;
+	}
+	memmove(s->rbuf + s->msglen, pos, end - pos);
+	s->rbuflen = s->msglen + (end - pos);
+}
+
+/* whether a packet only has meters, named by the address of its first message */
+static bool
+meterkey(const unsigned char *buf, size_t len, char *key, size_t keylen)
+{
+	const unsigned char *pos, *end;
+	const char *addr;
+	size_t n, addrlen;
+
+	if (len <= 16 || memcmp(buf, "#bundle", 8) != 0)
+		return false;
+	key[0] = '\0';
+	end = buf + len;
+	for (pos = buf + 16; pos < end; pos += 4 + n) {
+		if (end - pos < 4)
+			return false;
+		n = getbe32(pos);
+		if (n > end - pos - 4)
+			return false;
+		addr = (const char *)pos + 4;
+		addrlen = strnlen(addr, n);
+		/* the sequence number of multicast output says nothing about the contents */
+		if (addrlen == 4 && memcmp(addr, "/seq", 4) == 0)
+			continue;
+		if (addrlen == n || addrlen < 6 || memcmp(addr + addrlen - 6, "/level", 6) != 0)
+			return false;
+		if (key[0] == '\0') {
+			if (addrlen >= keylen)
+				return false;
+			memcpy(key, addr, addrlen + 1);
+		}
+	}
+	return key[0] != '\0';
+}
+
+/* removes the queued meters a newer packet with the same key replaces */
+static void
+dropmeter(struct stream *s, const char *key)
+{
+	size_t i, j, off, len;
+
+	for (i = 0; i < s->meterslen; ++i) {
+		if (strcmp(s->meters[i].key, key) == 0)
+			break;
+	}
+	if (i == s->meterslen)
+		return;
+	off = s->meters[i].off;
+	len = s->meters[i].len;
+	memmove(s->wbuf + off, s->wbuf + off + len, s->wbuflen - off - len);
+	s->wbuflen -= len;
+	for (j = i + 1; j < s->meterslen; ++j) {
+		s->meters[j - 1] = s->meters[j];
+		if (s->meters[j - 1].off > off)
+			s->meters[j - 1].off -= len;
+	}
+	--s->meterslen;
+	++s->metersdropped;
+}
+
+/* accounts for sent output; meters that were started can no longer be dropped */
+static void
+forgetmeters(struct stream *s, size_t sent)
+{
+	size_t i, j;
+
+	for (i = 0, j = 0; i < s->meterslen; ++i) {
+		if (s->meters[i].off >= sent) {
+			s->meters[j] = s->meters[i];
+			s->meters[j++].off -= sent;
+		}
+	}
+	s->meterslen = j;
+}
+
+/* sends the file after the queued output, then answers the requests that waited for it */
+static void
+sendbody(struct stream *s)
+{
+	ssize_t ret;
+#ifndef __linux__
+	char buf[16384];
+#endif
+
+	while (s->fileoff < s->filelen) {
+#ifdef __linux__
+		ret = sendfile(s->fd, s->filefd, &s->fileoff, s->filelen - s->fileoff);
+#else
+		ret = pread(s->filefd, buf, s->filelen - s->fileoff < sizeof buf ? s->filelen - s->fileoff : sizeof buf, s->fileoff);
+		if (ret > 0) {
+			ret = send(s->fd, buf, ret, MSG_NOSIGNAL);
+			if (ret > 0)
+				s->fileoff += ret;
+		}
+#endif
+		if (ret < 0) {
+			if (sendagain(s))
+				return;
+			break;
+		}
+		if (ret == 0) {
+			fprintf(stderr, "file was truncated while sending; closing connection\n");
+			s->dead = true;
+			break;
+		}
+	}
+	close(s->filefd);
+	s->filefd = -1;
+	httpserve(s);
+}
+
+void
+streamflush(struct stream *s)
+{
+	unsigned char *pos, *end;
+	size_t len;
+	ssize_t ret;
+
+	pos = s->wbuf;
+	end = s->wbuf + s->wbuflen;
+	while (pos < end) {
+		/* packets are queued with a size prefix, and sent whole */
+		len = s->framing == FRAME_PACKET ? getbe32(pos) : end - pos;
+		ret = send(s->fd, s->framing == FRAME_PACKET ? pos + 4 : pos, len, MSG_NOSIGNAL);
+		if (ret < 0) {
+			if (sendagain(s))
+				break;
+			return;
+		}
+		pos += s->framing == FRAME_PACKET ? 4 + len : ret;
+	}
+	forgetmeters(s, pos - s->wbuf);
+	s->wbuflen = end - pos;
+	memmove(s->wbuf, pos, s->wbuflen);
+	if (s->wbuflen == 0 && s->filefd >= 0)
+		sendbody(s);
+}
+
+/* returns the amount of output not yet sent */
+size_t
+streamqueued(struct stream *s)
+{
+	return s->wbuflen + (s->filefd >= 0 ? s->filelen - s->fileoff : 0);
+}
+
+static void
+framewrite(struct stream *s, const unsigned char *buf, size_t len, bool compress)
+{
+	const unsigned char *end;
+	unsigned char *pos;
+
+	if (s->framing == FRAME_WS) {
+		if (compress && s->deflate && (end = wsdeflate(s->deflate, buf, &len)))
+			wswrite(s, WS_BINARY | WS_RSV1, end, len);
+		else
+			wswrite(s, WS_BINARY, buf, len);
+		return;
+	}
+	pos = reserve(s, s->framing == FRAME_SLIP ? 2 + 2 * len : 4 + len);
+	if (!pos)
+		return;
+	switch (s->framing) {
+	case FRAME_SLIP:
+		*pos++ = SLIP_END;
+		for (end = buf + len; buf < end; ++buf) {
+			switch (*buf) {
+			case SLIP_END:
+				*pos++ = SLIP_ESC;
+				*pos++ = SLIP_ESCEND;
+				break;
+			case SLIP_ESC:
+				*pos++ = SLIP_ESC;
+				*pos++ = SLIP_ESCESC;
+				break;
+			default:
+				*pos++ = *buf;
+			}
+		}
+		*pos++ = SLIP_END;
+		break;
+	case FRAME_LEN:
+	case FRAME_PACKET:
+		pos = putbe32(pos, len);
+		memcpy(pos, buf, len);
+		pos += len;
+		break;
+	}
+	commit(s, pos);
+}
+
+/* queues a framed packet and writes as much as the socket takes */
+void
+streamwrite(struct stream *s, const unsigned char *buf, size_t len)
+{
+	char key[sizeof s->meters[0].key];
+	size_t start;
+	bool meter;
+
+	if (s->dead)
+		return;
+	/* clients are sent nothing until they are upgraded */
+	if (s->framing == FRAME_WS && !s->upgraded)
+		return;
+	meter = meterkey(buf, len, key, sizeof key);
+	if (meter)
+		dropmeter(s, key);
+	start = s->wbuflen;
+	/* with context takeover, a compressed message can't be dropped, so queued meters go uncompressed */
+	framewrite(s, buf, len, !meter || start == 0);
+	/* only a packet behind others is still wholly queued */
+	if (meter && start > 0 && !s->dead) {
+		if (s->meterslen == LEN(s->meters))
+			memmove(s->meters, s->meters + 1, --s->meterslen * sizeof *s->meters);
+		s->meters[s->meterslen].off = start;
+		s->meters[s->meterslen].len = s->wbuflen - start;
+		memcpy(s->meters[s->meterslen].key, key, sizeof key);
+		++s->meterslen;
+	}
+}
@@ -0,0 +1,49 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* stop reading from a connection while this much output is queued */
+#define STREAMHIGH (1 << 16)
+/* close a connection once this much output is queued */
+#define STREAMMAX (1 << 20)
+
+/* an OSC connection over a stream socket */
+struct stream {
+	int fd;
+	int framing;
+	unsigned char rbuf[16384];
+	size_t rbuflen;
+	/* WebSocket: whether the upgrade is done, and the message fragments at the start of rbuf */
+	bool upgraded;
+	size_t msglen;
+	/* permessage-deflate state if negotiated, and whether the message in rbuf is compressed */
+	struct wsdeflate *deflate;
+	bool msgdeflated;
+	/* framed packets that could not be written without blocking */
+	unsigned char *wbuf;
+	size_t wbuflen, wbufcap;
+	/* a file sent once wbuf is empty, or -1 */
+	int filefd;
+	off_t fileoff, filelen;
+	/* level packets still wholly queued, which newer ones with the same key replace */
+	struct {
+		size_t off, len;
+		char key[32];
+	} meters[8];
+	size_t meterslen;
+	unsigned long metersdropped;
+	/* set on EOF, error, or overflow; the owner closes it */
+	bool dead;
+};
+
+struct stream *streamopen(int fd, int framing);
+void streamclose(struct stream *s);
+void streamread(struct stream *s, void (*handle)(const unsigned char *, size_t));
+void streamwrite(struct stream *s, const unsigned char *buf, size_t len);
+void streamflush(struct stream *s);
+size_t streamqueued(struct stream *s);
+
+#endif
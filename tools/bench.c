@@ -0,0 +1,385 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "../arg.h"
+#include "../device.h"
+#include "../intpack.h"
+#include "../oscmix.h"
+#include "../osc.h"
+#include "../sysex.h"
+#include "../util.h"
+#include "../ws.h"
+#include "common.h"
+
+#define LEN(a) (sizeof (a) / sizeof *(a))
+
+/* a SysEx message as the device sends it */
+struct msg {
+	size_t len;
+	unsigned char buf[SYSEXLEN(3 * 64)];
+};
+
+struct workload {
+	const char *name;
+	void (*setup)(void);
+	void (*op)(unsigned long i);
+	bool deflate;  /* needs a build with zlib */
+};
+
+static const struct device *device;
+static struct mixer *mixer;
+static uint32_t payload[8192 / 4];
+static struct msg *dump;
+static size_t dumplen;
+static struct msg levels[2][5];
+static struct msg regmsg;
+static unsigned char oscmsgs[64][64];
+static size_t oscmsgslen[64];
+static unsigned long allocs, allocbytes, outbytes;
+/* compresses the output as for a WebSocket client, if set */
+static struct wsdeflate *deflater;
+
+/* the allocator is wrapped at link time; allocations inside libraries are not counted */
+void *__real_malloc(size_t);
+void *__real_calloc(size_t, size_t);
+void *__real_realloc(void *, size_t);
+
+void *
+__wrap_malloc(size_t size)
+{
+	++allocs;
+	allocbytes += size;
+	return __real_malloc(size);
+}
+
+void *
+__wrap_calloc(size_t n, size_t size)
+{
+	++allocs;
+	allocbytes += n * size;
+	return __real_calloc(n, size);
+}
+
+void *
+__wrap_realloc(void *ptr, size_t size)
+{
+	++allocs;
+	allocbytes += size;
+	return __real_realloc(ptr, size);
+}
+
+void
+writemidi(void *arg, const void *buf, size_t len)
+{
+	outbytes += len;
+}
+
+void
+writeosc(const void *buf, size_t len)
+{
+	if (deflater)
+		wsdeflate(deflater, buf, &len);
+	outbytes += len;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: bench [-d device] [-t ms] [workload...]\n");
+	exit(1);
+}
+
+static void
+encode(struct msg *m, int subid, const uint_least32_t *words, size_t len)
+{
+	m->len = encodesysex(m->buf, subid, words, len);
+}
+
+static void
+oscencode(int i, const char *addr, float val)
+{
+	struct oscmsg msg;
+
+	msg.buf = oscmsgs[i];
+	msg.end = oscmsgs[i] + sizeof oscmsgs[i];
+	msg.type = NULL;
+	msg.err = NULL;
+	oscputstr(&msg, addr);
+	oscputstr(&msg, ",f");
+	oscputfloat(&msg, val);
+	oscmsgslen[i] = msg.buf - oscmsgs[i];
+}
+
+static void
+adddump(const uint_least32_t *words, size_t len)
+{
+	static size_t cap;
+
+	if (dumplen == cap) {
+		cap = cap ? cap * 2 : 64;
+		dump = realloc(dump, cap * sizeof *dump);
+		if (!dump)
+			fatal(NULL);
+	}
+	encode(&dump[dumplen++], 0, words, len);
+}
+
+/* every register the device reports, 64 to a message like a refresh */
+static void
+setupdump(void)
+{
+	const struct regmap *map;
+	uint_least32_t words[64];
+	size_t n;
+	int in, out, ins, outs, reg, val;
+
+	dumplen = 0;
+	n = 0;
+	for (map = device->regmap; map != device->regmap + device->regmaplen; ++map) {
+		if (map->flags & (REG_WRONLY | REG_COMMAND))
+			continue;
+		ins = 1;
+		if (map->flags & REG_INPUT)
+			ins = device->inputslen;
+		else if (map->flags & REG_PLAYBACK)
+			ins = device->outputslen;
+		outs = map->flags & REG_OUTPUT ? device->outputslen : 1;
+		for (out = 0; out < outs; ++out) {
+			for (in = 0; in < ins; ++in) {
+				if (map->flags & (REG_INPUT | REG_PLAYBACK) && map->flags & REG_OUTPUT)
+					reg = map->reg + out * map->stride + in;
+				else
+					reg = map->reg + (map->flags & (REG_INPUT | REG_PLAYBACK) ? in : out) * map->stride;
+				switch (map->ctl) {
+				case MIX: val = -650; break;        /* muted */
+				case DUREC_INDEX: val = -1; break;  /* no file selected */
+				default: val = 0; break;
+				}
+				words[n++] = (uint_least32_t)reg << 16 | (val & 0xffff);
+				if (n == LEN(words)) {
+					adddump(words, n);
+					n = 0;
+				}
+			}
+		}
+	}
+	if (n > 0)
+		adddump(words, n);
+}
+
+static void
+refresh(unsigned long i)
+{
+	size_t j;
+
+	for (j = 0; j < dumplen; ++j)
+		handlesysex(mixer, dump[j].buf, dump[j].len, payload);
+}
+
+/* two sets of levels, so alternate sets change every meter */
+static void
+setuplevels(void)
+{
+	uint_least32_t words[3 * 64];
+	size_t i, j, k, n;
+
+	for (k = 0; k < 2; ++k) {
+		for (j = 0; j < LEN(levelsubids); ++j) {
+			n = levelslen(device, levelsubids[j]);
+			for (i = 0; i < n; ++i)
+				putlevel(&words[3 * i], 0.1 + 0.4 * k + 0.01 * i);
+			encode(&levels[k][j], levelsubids[j], words, 3 * n);
+		}
+	}
+}
+
+static void
+meters(unsigned long i)
+{
+	size_t j;
+
+	for (j = 0; j < LEN(levels[0]); ++j)
+		handlesysex(mixer, levels[i & 1][j].buf, levels[i & 1][j].len, payload);
+	handletimer(true);
+}
+
+static void
+setupfaders(void)
+{
+	char addr[32];
+	int i;
+
+	for (i = 0; i < LEN(oscmsgs); ++i) {
+		snprintf(addr, sizeof addr, "/mix/%d/input/%d", i % 2 + 1, i / 2 % device->inputslen + 1);
+		oscencode(i, addr, -30 + i % 7 * 5);
+	}
+}
+
+static void
+faders(unsigned long i)
+{
+	handleosc(oscmsgs[i % LEN(oscmsgs)], oscmsgslen[i % LEN(oscmsgs)]);
+}
+
+static void
+setupgain(void)
+{
+	int i;
+
+	for (i = 0; i < LEN(oscmsgs); ++i)
+		oscencode(i, "/output/1/volume", -20 + i % 16);
+}
+
+static void
+setupecho(void)
+{
+	setupdump();
+}
+
+/* the device reporting single register changes from a refresh dump */
+static void
+echo(unsigned long i)
+{
+	const struct msg *m;
+	uint32_t word;
+
+	m = &dump[i % dumplen];
+	word = getle32_7bit(m->buf + 6 + i / dumplen % ((m->len - 7) / 5) * 5);
+	word ^= i & 1;
+	encode(&regmsg, 0, &word, 1);
+	handlesysex(mixer, regmsg.buf, regmsg.len, payload);
+}
+
+static void
+setupcodec(void)
+{
+	setupdump();
+}
+
+static void
+codec(unsigned long i)
+{
+	struct sysex sysex;
+	const struct msg *m;
+	uint_least32_t words[64];
+	size_t j;
+
+	m = &dump[i % dumplen];
+	if (sysexdec(&sysex, m->buf, m->len, SYSEX_MFRID | SYSEX_DEVID | SYSEX_SUBID) != 0)
+		fatal("sysexdec failed");
+	for (j = 0; j < sysex.datalen / 5; ++j)
+		words[j] = getle32_7bit(sysex.data + j * 5);
+	encode(&regmsg, 0, words, j);
+}
+
+static void
+setupdeflate(const char *level)
+{
+	struct wsrequest req = {0};
+
+	setuplevels();
+	wsdeflateinit(level);
+	wsdeflatefree(deflater);
+	deflater = wsdeflatenew(&req);
+}
+
+static void
+setupdeflate1(void)
+{
+	setupdeflate("1");
+}
+
+static void
+setupdeflate6(void)
+{
+	setupdeflate("6");
+}
+
+static const struct workload workloads[] = {
+	{"codec", setupcodec, codec},      /* decode and re-encode a 64 register message */
+	{"refresh", setupdump, refresh},   /* a full register dump */
+	{"meters", setuplevels, meters},   /* one set of level packets and a timer tick */
+	{"faders", setupfaders, faders},   /* one mix fader move from a client */
+	{"volume", setupgain, faders},     /* one output volume move from a client */
+	{"echo", setupecho, echo},         /* one register change from the device */
+	/* meters, with output compressed for a WebSocket client with permessage-deflate */
+	{"deflate1", setupdeflate1, meters, true},
+	{"deflate6", setupdeflate6, meters, true},
+};
+
+static void
+run(const struct workload *w, uint_least64_t duration)
+{
+	unsigned long ops, batch, i;
+	unsigned long startallocs, startbytes, startout;
+	uint_least64_t start, elapsed;
+
+	w->setup();
+	/* warm up, then time batches until the duration has passed */
+	for (i = 0; i < 16; ++i)
+		w->op(i);
+	startallocs = allocs;
+	startbytes = allocbytes;
+	startout = outbytes;
+	ops = 0;
+	batch = 1;
+	start = now();
+	do {
+		for (i = 0; i < batch; ++i)
+			w->op(ops + i);
+		ops += batch;
+		if (batch < 1 << 16)
+			batch *= 2;
+		elapsed = now() - start;
+	} while (elapsed < duration);
+	printf("%s\t%lu\t%.1f\t%.1f\t%.2f\t%.1f\n", w->name, ops, (double)elapsed / ops,
+		(double)(allocbytes - startbytes) / ops, (double)(allocs - startallocs) / ops,
+		(double)(outbytes - startout) / ops);
+	fflush(stdout);
+}
+
+int
+main(int argc, char *argv[])
+{
+	uint_least64_t duration;
+	const char *name;
+	size_t i;
+	int j;
+
+	name = NULL;
+	duration = 500000000;
+	ARGBEGIN {
+	case 'd':
+		name = EARGF(usage());
+		break;
+	case 't':
+		duration = strtod(EARGF(usage()), NULL) * 1e6;
+		break;
+	default:
+		usage();
+	} ARGEND
+	device = lookupdevice(name);
+	mixer = newmixer(device->id, NULL);
+	if (!mixer)
+		return 1;
+	printf("workload\tops\tns/op\talloc_bytes/op\tallocs/op\tout_bytes/op\n");
+	for (i = 0; i < LEN(workloads); ++i) {
+		if (argc > 0) {
+			for (j = 0; j < argc && strcmp(argv[j], workloads[i].name) != 0; ++j)
+				;
+			if (j == argc)
+				continue;
+		}
+		if (workloads[i].deflate && !wsdeflatesupported) {
+			fprintf(stderr, "bench: %s: built without zlib\n", workloads[i].name);
+			continue;
+		}
+		run(&workloads[i], duration);
+	}
+	return 0;
+}
@@ -0,0 +1,104 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "../device.h"
+#include "../sysex.h"
+#include "../util.h"
+#include "common.h"
+
+const int levelsubids[5] = {4, 1, 5, 3, 2};
+
+uint_least64_t
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint_least64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* by name or id, defaulting to the UCX II */
+const struct device *
+lookupdevice(const char *name)
+{
+	size_t i;
+
+	if (!name)
+		name = "Fireface UCX II";
+	for (i = 0; i < deviceslen; ++i) {
+		if (strcmp(name, devices[i]->name) == 0 || strcmp(name, devices[i]->id) == 0)
+			return devices[i];
+	}
+	fatal("unknown device '%s'", name);
+	return NULL;
+}
+
+/* runs cmd as oscmix would run under alsarawio, with the device on fds 6 and 7 */
+pid_t
+spawn(const struct device *device, char *argv[], int *fd)
+{
+	int sv[2];
+	pid_t pid;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+		fatal("socketpair:");
+	pid = fork();
+	if (pid < 0)
+		fatal("fork:");
+	if (pid == 0) {
+		close(sv[0]);
+		if (dup2(sv[1], 6) < 0 || dup2(sv[1], 7) < 0)
+			fatal("dup2:");
+		if (sv[1] != 6 && sv[1] != 7)
+			close(sv[1]);
+		setenv("MIDIPORT", device->id, 1);
+		execvp(argv[0], argv);
+		fatal("exec %s:", argv[0]);
+	}
+	close(sv[1]);
+	*fd = sv[0];
+	return pid;
+}
+
+/* buf must hold SYSEXLEN(len) bytes */
+size_t
+encodesysex(unsigned char *buf, int subid, const uint_least32_t *words, size_t len)
+{
+	struct sysex sysex;
+	unsigned char *pos;
+	size_t i, buflen;
+
+	sysex.mfrid = 0x200d;
+	sysex.devid = 0x10;
+	sysex.subid = subid;
+	sysex.data = NULL;
+	sysex.datalen = len * 5;
+	buflen = sysexenc(&sysex, buf, SYSEX_MFRID | SYSEX_DEVID | SYSEX_SUBID);
+	pos = sysex.data;
+	for (i = 0; i < len; ++i)
+		pos = putle32_7bit(pos, words[i]);
+	return buflen;
+}
+
+size_t
+levelslen(const struct device *device, int subid)
+{
+	return subid == 1 || subid == 4 ? device->inputslen : device->outputslen;
+}
+
+/* the 3 words of one channel's level: 64-bit RMS, then peak */
+void
+putlevel(uint_least32_t *words, double amp)
+{
+	uint_least64_t rms;
+
+	rms = amp * amp / 2 * 0x1p54;
+	words[0] = rms & 0xffffffff;
+	words[1] = rms >> 32;
+	words[2] = (uint_least32_t)(amp * 0x1p23) << 4;
+}
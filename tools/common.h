@@ -0,0 +1,23 @@
+#ifndef TOOLS_COMMON_H
+#define TOOLS_COMMON_H
+
+/* helpers for the tools that stand in for a device */
+
+struct device;
+
+uint_least64_t now(void);
+const struct device *lookupdevice(const char *name);
+pid_t spawn(const struct device *device, char *argv[], int *fd);
+
+/* a 6 byte header, 5 bytes per word, and the end byte */
+#define SYSEXLEN(n) (7 + (n) * 5)
+
+size_t encodesysex(unsigned char *buf, int subid, const uint_least32_t *words, size_t len);
+
+/* level packets, in the order the device sends them */
+extern const int levelsubids[5];
+
+size_t levelslen(const struct device *device, int subid);
+void putlevel(uint_least32_t *words, double amp);
+
+#endif
@@ -0,0 +1,473 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../arg.h"
+#include "../device.h"
+#include "../sysex.h"
+#include "../util.h"
+#include "common.h"
+
+#define LEN(a) (sizeof (a) / sizeof *(a))
+
+/* message to the host, held back to model latency and throughput */
+struct msg {
+	uint_least64_t due;
+	struct msg *next;
+	size_t len;
+	unsigned char buf[];
+};
+
+static const struct device *device;
+static int fd;
+static pid_t child;
+static int32_t regs[0x8000];  /* -1 if the device has no such register */
+static unsigned char regflags[0x8000];
+static struct msg *queue, **queuetail = &queue;
+static uint_least64_t latency;  /* in ns */
+static unsigned long rate;       /* bytes per second, or 0 for unlimited */
+static double tokens;
+static uint_least64_t tokenstime;
+static double loss;              /* probability of dropping a message */
+static unsigned long levelrate = 30;
+static uint_least64_t levelsrequested;
+static uint_least64_t seed = 1;
+static int vflag;
+static struct {
+	unsigned long in, out, dropped, dumps, levels;
+} stats;
+static struct {
+	int status;
+	int time;
+	int numfiles;
+} durec = {5};
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: ffsim [-v] [-d device] [-l levelrate] [-L latency] [-b rate] [-p loss] [-s seed] cmd [arg...]\n");
+	exit(1);
+}
+
+/* xorshift, so runs with the same seed drop the same messages */
+static double
+random01(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (seed >> 11) * 0x1p-53;
+}
+
+static void
+queuemsg(int subid, const uint_least32_t *words, size_t len)
+{
+	struct msg *m;
+
+	if (loss > 0 && random01() < loss) {
+		++stats.dropped;
+		return;
+	}
+	m = malloc(sizeof *m + SYSEXLEN(len));
+	if (!m)
+		fatal(NULL);
+	m->len = encodesysex(m->buf, subid, words, len);
+	m->due = now() + latency;
+	m->next = NULL;
+	*queuetail = m;
+	queuetail = &m->next;
+	++stats.out;
+}
+
+/* sends register values in messages of at most 64 registers */
+static void
+sendregs(const int *list, size_t len)
+{
+	uint_least32_t words[64];
+	size_t i, n;
+
+	n = 0;
+	for (i = 0; i < len; ++i) {
+		words[n++] = (uint_least32_t)list[i] << 16 | (regs[list[i]] & 0xffff);
+		if (n == LEN(words)) {
+			queuemsg(0, words, n);
+			n = 0;
+		}
+	}
+	if (n > 0)
+		queuemsg(0, words, n);
+}
+
+static void
+sendreg(int reg)
+{
+	sendregs(&reg, 1);
+}
+
+/* returns the register of a global control */
+static int
+findreg(enum control ctl)
+{
+	const struct regmap *map;
+
+	for (map = device->regmap; map != device->regmap + device->regmaplen; ++map) {
+		if (map->ctl == ctl && !(map->flags & (REG_INPUT | REG_PLAYBACK | REG_OUTPUT)))
+			return map->reg;
+	}
+	return -1;
+}
+
+static void
+setreg(enum control ctl, int val)
+{
+	int reg;
+
+	reg = findreg(ctl);
+	if (reg != -1) {
+		regs[reg] = val & 0xffff;
+		sendreg(reg);
+	}
+}
+
+/* creates the registers described by the register map */
+static void
+initregs(void)
+{
+	const struct regmap *map;
+	int i, in, out, ins, outs, flags, reg, val;
+
+	for (i = 0; i < LEN(regs); ++i)
+		regs[i] = -1;
+	for (map = device->regmap; map != device->regmap + device->regmaplen; ++map) {
+		ins = 1;
+		if (map->flags & REG_INPUT)
+			ins = device->inputslen;
+		else if (map->flags & REG_PLAYBACK)
+			ins = device->outputslen;
+		outs = map->flags & REG_OUTPUT ? device->outputslen : 1;
+		for (out = 0; out < outs; ++out) {
+			for (in = 0; in < ins; ++in) {
+				val = 0;
+				if (map->flags & (REG_INPUT | REG_PLAYBACK) && map->flags & REG_OUTPUT) {
+					reg = map->reg + out * map->stride + in;
+					/* all mix cells start muted */
+					if (map->ctl == MIX)
+						val = -650;
+				} else {
+					i = map->flags & (REG_INPUT | REG_PLAYBACK) ? in : out;
+					if (map->flags & REG_PAIR)
+						i >>= 1;
+					reg = map->reg + i * map->stride;
+					flags = 0;
+					if (map->flags & REG_INPUT)
+						flags = device->inputs[in].flags;
+					else if (map->flags & REG_OUTPUT)
+						flags = device->outputs[out].flags;
+					if ((flags & map->chanflags) != map->chanflags)
+						continue;
+				}
+				if (reg < 0 || reg >= LEN(regs))
+					continue;
+				regs[reg] = val & 0xffff;
+				regflags[reg] |= map->flags;
+			}
+		}
+	}
+	/* 48 kHz, DSP version 16, no DURec media inserted yet */
+	if ((i = findreg(CLOCK_SAMPLERATE)) != -1)
+		regs[i] = 2;
+	if ((i = findreg(HARDWARE_DSPVERLOAD)) != -1)
+		regs[i] = 16 << 8 | 10;
+	if ((i = findreg(DUREC_STATUS)) != -1)
+		regs[i] = durec.status;
+}
+
+/* answers a refresh with every register the device reports */
+static void
+dump(void)
+{
+	int list[LEN(regs)];
+	size_t len;
+	int reg;
+
+	len = 0;
+	for (reg = 0; reg < LEN(regs); ++reg) {
+		if (regs[reg] != -1 && !(regflags[reg] & REG_WRONLY))
+			list[len++] = reg;
+	}
+	sendregs(list, len);
+	++stats.dumps;
+}
+
+static void
+durecstatus(int status)
+{
+	durec.status = status;
+	setreg(DUREC_STATUS, status);
+}
+
+static void
+dureccommand(enum control ctl, int val)
+{
+	switch (ctl) {
+	case DUREC_CONTROL:
+		switch (val) {
+		case 0x8120:
+			/* a finished recording becomes a new file */
+			if (durec.status == 6)
+				setreg(DUREC_NUMFILES, ++durec.numfiles);
+			durecstatus(5);
+			break;
+		case 0x8122: durec.time = 0, durecstatus(6); break;
+		case 0x8123: durec.time = 0, durecstatus(10); break;
+		}
+		break;
+	case DUREC_DELETE:
+		if (durec.numfiles > 0)
+			setreg(DUREC_NUMFILES, --durec.numfiles);
+		break;
+	default:
+		break;
+	}
+}
+
+static void
+handleregs(const uint_least32_t *words, size_t len)
+{
+	const struct regmap *map;
+	size_t i;
+	int reg, val;
+
+	for (i = 0; i < len; ++i) {
+		reg = words[i] >> 16 & 0x7fff;
+		val = words[i] & 0xffff;
+		if (vflag)
+			fprintf(stderr, "ffsim: [%.4X]=%.4X\n", reg, val);
+		if (reg == 0x3F00) {
+			queuemsg(0, &words[i], 1);
+			continue;
+		}
+		if (regs[reg] == -1 || regflags[reg] & REG_RDONLY)
+			continue;
+		if (regflags[reg] & REG_COMMAND) {
+			for (map = device->regmap; map->reg != reg; ++map)
+				;
+			if (map->ctl == REFRESH) {
+				if (val == device->refresh)
+					dump();
+			} else {
+				dureccommand(map->ctl, val);
+			}
+			continue;
+		}
+		regs[reg] = val;
+		/* the device reports changed registers back */
+		if (!(regflags[reg] & REG_WRONLY))
+			sendreg(reg);
+	}
+}
+
+static void
+handlemsg(const unsigned char *buf, size_t len)
+{
+	struct sysex sysex;
+	uint_least32_t words[8192 / 5];
+	size_t i;
+
+	++stats.in;
+	if (loss > 0 && random01() < loss) {
+		++stats.dropped;
+		return;
+	}
+	if (sysexdec(&sysex, buf, len, SYSEX_MFRID | SYSEX_DEVID | SYSEX_SUBID) != 0 || sysex.mfrid != 0x200d || sysex.datalen % 5 != 0) {
+		fprintf(stderr, "ffsim: ignoring unknown sysex\n");
+		return;
+	}
+	for (i = 0; i < sysex.datalen / 5; ++i)
+		words[i] = getle32_7bit(sysex.data + i * 5);
+	switch (sysex.subid) {
+	case 0: handleregs(words, i); break;
+	case 2: levelsrequested = now(); break;
+	}
+}
+
+/* sends one set of level packets, following a slow sine per channel */
+static void
+sendlevels(uint_least64_t t)
+{
+	uint_least32_t words[3 * 64];
+	size_t i, n, j;
+	int subid;
+
+	for (j = 0; j < LEN(levelsubids); ++j) {
+		subid = levelsubids[j];
+		n = levelslen(device, subid);
+		for (i = 0; i < n; ++i)
+			putlevel(&words[3 * i], 0.5 + 0.49 * sin(t / 1e9 + i * 0.7 + subid));
+		queuemsg(subid, words, 3 * n);
+	}
+	++stats.levels;
+}
+
+/* writes queued messages that are due, as far as the rate allows */
+static void
+flushqueue(uint_least64_t t)
+{
+	struct msg *m;
+	ssize_t ret;
+
+	if (rate > 0) {
+		tokens += (t - tokenstime) / 1e9 * rate;
+		if (tokens > rate / 10 + 8192)
+			tokens = rate / 10 + 8192;
+		tokenstime = t;
+	}
+	while ((m = queue) && m->due <= t) {
+		if (rate > 0 && tokens < m->len)
+			break;
+		ret = write(fd, m->buf, m->len);
+		if (ret < 0) {
+			if (errno == EPIPE)
+				return;
+			fatal("write:");
+		}
+		tokens -= m->len;
+		queue = m->next;
+		if (!queue)
+			queuetail = &queue;
+		free(m);
+	}
+}
+
+/* passes termination on to the command; ffsim exits with it */
+static void
+forward(int sig)
+{
+	kill(child, sig);
+}
+
+int
+main(int argc, char *argv[])
+{
+	static unsigned char buf[8192];
+	const char *name;
+	unsigned char *pos, *end, *start;
+	size_t buflen;
+	uint_least64_t t, next, tick, second;
+	struct pollfd pfd;
+	ssize_t ret;
+	int timeout, status, reg;
+
+	name = NULL;
+	ARGBEGIN {
+	case 'd':
+		name = EARGF(usage());
+		break;
+	case 'l':
+		levelrate = strtoul(EARGF(usage()), NULL, 10);
+		break;
+	case 'L':
+		latency = strtod(EARGF(usage()), NULL) * 1e6;
+		break;
+	case 'b':
+		rate = strtoul(EARGF(usage()), NULL, 10);
+		break;
+	case 'p':
+		loss = strtod(EARGF(usage()), NULL) / 100;
+		break;
+	case 's':
+		seed = strtoull(EARGF(usage()), NULL, 10) | 1;
+		break;
+	case 'v':
+		vflag = 1;
+		break;
+	default:
+		usage();
+	} ARGEND
+	if (argc < 1)
+		usage();
+	device = lookupdevice(name);
+	initregs();
+	signal(SIGPIPE, SIG_IGN);
+	child = spawn(device, argv, &fd);
+	signal(SIGINT, forward);
+	signal(SIGTERM, forward);
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	buflen = 0;
+	tokenstime = now();
+	tick = tokenstime;
+	second = tokenstime;
+	for (;;) {
+		t = now();
+		next = UINT64_MAX;
+		if (queue)
+			next = queue->due > t ? queue->due : t + 1000000;
+		if (levelrate > 0 && t - levelsrequested < 1000000000 && tick < next)
+			next = tick;
+		if (second < next)
+			next = second;
+		timeout = next > t ? (next - t + 999999) / 1000000 : 0;
+		if (poll(&pfd, 1, timeout) < 0 && errno != EINTR)
+			fatal("poll:");
+		t = now();
+		if (pfd.revents & (POLLIN | POLLHUP)) {
+			ret = read(fd, buf + buflen, sizeof buf - buflen);
+			if (ret < 0)
+				fatal("read:");
+			if (ret == 0)
+				break;
+			buflen += ret;
+			end = buf + buflen;
+			pos = buf;
+			while ((start = memchr(pos, 0xf0, end - pos)) && (pos = memchr(start, 0xf7, end - start))) {
+				++pos;
+				handlemsg(start, pos - start);
+			}
+			if (!start) {
+				buflen = 0;
+			} else if (start == buf && buflen == sizeof buf) {
+				fprintf(stderr, "ffsim: sysex message too large; dropping\n");
+				buflen = 0;
+			} else {
+				buflen = end - start;
+				memmove(buf, start, buflen);
+			}
+		}
+		if (levelrate > 0 && t >= tick) {
+			if (t - levelsrequested < 1000000000)
+				sendlevels(t);
+			tick += 1000000000 / levelrate;
+			if (tick < t)
+				tick = t;
+		}
+		if (t >= second) {
+			second += 1000000000;
+			/* DSP load wanders; the DURec clock runs while playing or recording */
+			reg = findreg(HARDWARE_DSPVERLOAD);
+			if (reg != -1) {
+				regs[reg] = (regs[reg] & 0xff00) | (int)(10 + 20 * random01());
+				sendreg(reg);
+			}
+			if (durec.status == 6 || durec.status == 10)
+				setreg(DUREC_TIME, ++durec.time);
+		}
+		flushqueue(t);
+	}
+	if (wait(&status) < 0)
+		fatal("wait:");
+	fprintf(stderr, "ffsim: %lu in, %lu out, %lu dropped, %lu dumps, %lu level sets\n",
+		stats.in, stats.out, stats.dropped, stats.dumps, stats.levels);
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
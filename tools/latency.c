@@ -0,0 +1,461 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../arg.h"
+#include "../device.h"
+#include "../intpack.h"
+#include "../osc.h"
+#include "../socket.h"
+#include "../sysex.h"
+#include "../util.h"
+#include "common.h"
+
+#define LEN(a) (sizeof (a) / sizeof *(a))
+
+enum direction {
+	OSCTOSYSEX,  /* fader move from a client until the register write */
+	SYSEXTOOSC,  /* device change until the OSC message */
+};
+
+static const struct device *device;
+static int fd;
+static int oscfd;
+static int clients[64];
+static pid_t child;
+static int gainreg;
+static char gainaddr[32];
+static int gainmin, gainmax;  /* in tenths of a dB */
+static int gainnext;
+/* send time of each gain value still in flight, or 0 */
+static uint_least64_t *pending;
+static uint_least64_t *lats;
+static size_t latslen;
+static unsigned long lost;
+static unsigned long meterrate;
+static uint_least64_t levelsrequested;
+static unsigned long levelsets;
+static enum direction direction;
+static unsigned char buf[8192];
+static size_t buflen;
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: latency [-d device] [-n samples] [-i interval] [-m meterrate,...] [-c clients,...] [-b burst,...] [-r addr] [-s addr] cmd [arg...]\n");
+	exit(1);
+}
+
+static void
+writesysex(int subid, const uint_least32_t *words, size_t len)
+{
+	unsigned char msg[SYSEXLEN(3 * 64)];
+	size_t msglen;
+
+	msglen = encodesysex(msg, subid, words, len);
+	if (write(fd, msg, msglen) != msglen)
+		fatal("write:");
+}
+
+static void
+writereg(int reg, int val)
+{
+	uint_least32_t word;
+
+	word = (uint_least32_t)reg << 16 | (val & 0xffff);
+	writesysex(0, &word, 1);
+}
+
+/* level packets for all channels, in the order the device sends them */
+static void
+writelevels(void)
+{
+	uint_least32_t words[3 * 64];
+	double amp;
+	size_t i, n, j;
+
+	amp = 0.25 + 0.25 * (levelsets % 16) / 16;
+	for (j = 0; j < LEN(levelsubids); ++j) {
+		n = levelslen(device, levelsubids[j]);
+		for (i = 0; i < n; ++i)
+			putlevel(&words[3 * i], amp);
+		writesysex(levelsubids[j], words, 3 * n);
+	}
+	++levelsets;
+}
+
+/* picks the next gain value; a value still in flight was lost */
+static int
+nextgain(uint_least64_t t)
+{
+	int val;
+
+	val = gainnext;
+	if (++gainnext > gainmax)
+		gainnext = gainmin;
+	if (pending[val - gainmin])
+		++lost;
+	pending[val - gainmin] = t;
+	return val;
+}
+
+static void
+sample(int val, uint_least64_t t)
+{
+	uint_least64_t *p;
+
+	if (val < gainmin || val > gainmax)
+		return;
+	p = &pending[val - gainmin];
+	if (*p) {
+		lats[latslen++] = t - *p;
+		*p = 0;
+	}
+}
+
+static void
+sendgain(int sock, int val)
+{
+	unsigned char msg[64];
+	struct oscmsg osc;
+
+	osc.buf = msg;
+	osc.end = msg + sizeof msg;
+	osc.type = NULL;
+	osc.err = NULL;
+	oscputstr(&osc, gainaddr);
+	oscputstr(&osc, ",f");
+	/* oscmix truncates to tenths */
+	oscputfloat(&osc, (val + 0.5) / 10);
+	if (write(sock, msg, osc.buf - msg) < 0 && errno != ECONNREFUSED)
+		fatal("write:");
+}
+
+static void
+handleregs(const uint_least32_t *words, size_t len, uint_least64_t t)
+{
+	size_t i;
+	int reg, val;
+
+	for (i = 0; i < len; ++i) {
+		reg = words[i] >> 16 & 0x7fff;
+		val = words[i] & 0xffff;
+		if (reg == 0x3F00) {
+			writesysex(0, &words[i], 1);
+		} else if (reg == gainreg) {
+			if (direction == OSCTOSYSEX)
+				sample(val, t);
+			/* the device reports the change back, as hardware does */
+			writereg(reg, val);
+		}
+	}
+}
+
+static void
+readdevice(uint_least64_t t)
+{
+	struct sysex sysex;
+	uint_least32_t words[LEN(buf) / 5];
+	unsigned char *pos, *end, *start;
+	ssize_t ret;
+	size_t i;
+
+	ret = read(fd, buf + buflen, sizeof buf - buflen);
+	if (ret < 0)
+		fatal("read:");
+	if (ret == 0)
+		fatal("device closed");
+	buflen += ret;
+	end = buf + buflen;
+	pos = buf;
+	while ((start = memchr(pos, 0xf0, end - pos)) && (pos = memchr(start, 0xf7, end - start))) {
+		++pos;
+		if (sysexdec(&sysex, start, pos - start, SYSEX_MFRID | SYSEX_DEVID | SYSEX_SUBID) != 0 || sysex.datalen % 5 != 0)
+			continue;
+		for (i = 0; i < sysex.datalen / 5; ++i)
+			words[i] = getle32_7bit(sysex.data + i * 5);
+		switch (sysex.subid) {
+		case 0: handleregs(words, i, t); break;
+		case 2: levelsrequested = t; break;
+		}
+	}
+	if (!start) {
+		buflen = 0;
+	} else if (start == buf && buflen == sizeof buf) {
+		buflen = 0;
+	} else {
+		buflen = end - start;
+		memmove(buf, start, buflen);
+	}
+}
+
+static void
+readosc(uint_least64_t t)
+{
+	unsigned char pkt[8192], *pos, *end;
+	struct oscmsg msg;
+	const char *addr;
+	ssize_t ret;
+	size_t len;
+
+	ret = read(oscfd, pkt, sizeof pkt);
+	if (ret < 0)
+		fatal("read:");
+	if (direction != SYSEXTOOSC || ret < 16 || memcmp(pkt, "#bundle", 8) != 0)
+		return;
+	pos = pkt + 16;
+	end = pkt + ret;
+	while (end - pos >= 4) {
+		len = getbe32(pos);
+		pos += 4;
+		if (len > end - pos || len % 4 != 0)
+			break;
+		msg.buf = pos;
+		msg.end = pos + len;
+		msg.type = "ss";
+		msg.err = NULL;
+		addr = oscgetstr(&msg);
+		msg.type = oscgetstr(&msg);
+		if (!msg.err && strcmp(addr, gainaddr) == 0 && strcmp(msg.type, ",f") == 0) {
+			++msg.type;
+			sample(lroundf(oscgetfloat(&msg) * 10), t);
+		}
+		pos += len;
+	}
+}
+
+/* services the device and clients until the deadline */
+static void
+serve(uint_least64_t deadline)
+{
+	struct pollfd pfd[2];
+	uint_least64_t t, next;
+	static uint_least64_t tick;
+
+	pfd[0].fd = fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = oscfd;
+	pfd[1].events = POLLIN;
+	for (;;) {
+		t = now();
+		if (meterrate > 0 && t - levelsrequested < 1000000000 && t >= tick) {
+			writelevels();
+			tick = t + 1000000000 / meterrate;
+		}
+		if (t >= deadline)
+			break;
+		next = deadline;
+		if (meterrate > 0 && t - levelsrequested < 1000000000 && tick < next)
+			next = tick;
+		if (poll(pfd, 2, (next - t + 999999) / 1000000) < 0 && errno != EINTR)
+			fatal("poll:");
+		t = now();
+		if (pfd[0].revents & (POLLIN | POLLHUP))
+			readdevice(t);
+		if (pfd[1].revents & POLLIN)
+			readosc(t);
+	}
+}
+
+static int
+compare(const void *a, const void *b)
+{
+	uint_least64_t x = *(const uint_least64_t *)a, y = *(const uint_least64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double
+percentile(double p)
+{
+	size_t i;
+
+	if (latslen == 0)
+		return NAN;
+	i = ceil(p * latslen);
+	if (i > 0)
+		--i;
+	return lats[i] / 1e3;
+}
+
+/* measures one direction at one load level and prints a report line */
+static void
+run(enum direction dir, unsigned long samples, uint_least64_t interval, size_t nclients, size_t burst)
+{
+	static const char *const names[] = {"osc-sysex", "sysex-osc"};
+	uint_least64_t t, next;
+	unsigned long sent;
+	size_t i, j, range;
+	int val;
+
+	range = gainmax - gainmin + 1;
+	memset(pending, 0, range * sizeof *pending);
+	latslen = 0;
+	lost = 0;
+	direction = dir;
+	next = now();
+	for (sent = 0; sent < samples;) {
+		t = now();
+		for (i = 0; i < (dir == OSCTOSYSEX ? nclients : 1); ++i) {
+			for (j = 0; j < burst && sent < samples; ++j, ++sent) {
+				val = nextgain(t);
+				if (dir == OSCTOSYSEX)
+					sendgain(clients[i], val);
+				else
+					writereg(gainreg, val);
+			}
+		}
+		next += interval;
+		serve(next);
+	}
+	/* give stragglers a second before counting them as lost */
+	serve(now() + 1000000000);
+	for (i = 0; i < range; ++i) {
+		if (pending[i])
+			++lost;
+	}
+	qsort(lats, latslen, sizeof *lats, compare);
+	printf("%s\t%lu\t%zu\t%zu\t%zu\t%lu\t%.1f\t%.1f\t%.1f\t%.1f\n",
+		names[dir], meterrate, nclients, burst, latslen, lost,
+		percentile(0.5), percentile(0.99), percentile(0.999),
+		latslen ? lats[latslen - 1] / 1e3 : NAN);
+	fflush(stdout);
+}
+
+static size_t
+parselist(char *str, unsigned long *list, size_t len)
+{
+	char *end;
+	size_t n;
+
+	for (n = 0; n < len; ++n) {
+		list[n] = strtoul(str, &end, 10);
+		if (end == str || (*end && *end != ','))
+			usage();
+		if (!*end)
+			return n + 1;
+		str = end + 1;
+	}
+	usage();
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	static char recvaddr[256] = "udp!127.0.0.1!7222";
+	static char sendaddr[256] = "udp!127.0.0.1!8222";
+	static char addr[256];
+	unsigned long meters[16] = {0}, nclients[16] = {1}, bursts[16] = {1};
+	size_t metersl = 1, nclientsl = 1, burstsl = 1, maxclients, i, j, k, l;
+	const struct regmap *map;
+	unsigned long samples;
+	uint_least64_t interval;
+	const char *name;
+	int status;
+
+	name = NULL;
+	samples = 1000;
+	interval = 10000000;
+	ARGBEGIN {
+	case 'd':
+		name = EARGF(usage());
+		break;
+	case 'n':
+		samples = strtoul(EARGF(usage()), NULL, 10);
+		break;
+	case 'i':
+		interval = strtod(EARGF(usage()), NULL) * 1e6;
+		break;
+	case 'm':
+		metersl = parselist(EARGF(usage()), meters, LEN(meters));
+		break;
+	case 'c':
+		nclientsl = parselist(EARGF(usage()), nclients, LEN(nclients));
+		break;
+	case 'b':
+		burstsl = parselist(EARGF(usage()), bursts, LEN(bursts));
+		break;
+	case 'r':
+		snprintf(recvaddr, sizeof recvaddr, "%s", EARGF(usage()));
+		break;
+	case 's':
+		snprintf(sendaddr, sizeof sendaddr, "%s", EARGF(usage()));
+		break;
+	default:
+		usage();
+	} ARGEND
+	if (argc < 1 || samples == 0)
+		usage();
+	device = lookupdevice(name);
+	for (map = device->regmap; map != device->regmap + device->regmaplen; ++map) {
+		if (map->ctl == INPUT_GAIN)
+			break;
+	}
+	/* the fader under test is the first input with a gain control */
+	for (i = 0; i < device->inputslen; ++i) {
+		if (device->inputs[i].flags & INPUT_HAS_GAIN)
+			break;
+	}
+	if (map == device->regmap + device->regmaplen || i == device->inputslen)
+		fatal("%s: no input has gain", device->name);
+	gainreg = map->reg + i * map->stride;
+	gainmin = device->inputs[i].gain.min * 10;
+	gainmax = device->inputs[i].gain.max * 10;
+	snprintf(gainaddr, sizeof gainaddr, "/input/%zu/gain", i + 1);
+	gainnext = gainmin;
+	maxclients = 0;
+	for (i = 0; i < nclientsl; ++i) {
+		if (nclients[i] > maxclients)
+			maxclients = nclients[i];
+		if (nclients[i] < 1 || nclients[i] > LEN(clients))
+			fatal("clients must be between 1 and %zu", LEN(clients));
+		for (j = 0; j < burstsl; ++j) {
+			if (nclients[i] * bursts[j] > gainmax - gainmin)
+				fatal("more than %d messages per interval", gainmax - gainmin);
+		}
+	}
+	pending = calloc(gainmax - gainmin + 1, sizeof *pending);
+	lats = calloc(samples, sizeof *lats);
+	if (!pending || !lats)
+		fatal(NULL);
+
+	memcpy(addr, sendaddr, sizeof addr);
+	oscfd = sockopen(addr, 1, NULL);
+	for (i = 0; i < maxclients; ++i) {
+		memcpy(addr, recvaddr, sizeof addr);
+		clients[i] = sockopen(addr, 0, NULL);
+	}
+	signal(SIGPIPE, SIG_IGN);
+	child = spawn(device, argv, &fd);
+
+	/* let oscmix start up and finish its initial refresh */
+	serve(now() + 3000000000);
+	printf("direction\tmeters\tclients\tburst\tsamples\tlost\tp50_us\tp99_us\tp999_us\tmax_us\n");
+	for (i = 0; i < metersl; ++i) {
+		meterrate = meters[i];
+		for (j = 0; j < nclientsl; ++j) {
+			for (k = 0; k < burstsl; ++k) {
+				for (l = 0; l < 2; ++l) {
+					if (l == SYSEXTOOSC && j > 0)
+						continue;
+					run(l, samples, interval, nclients[j], bursts[k]);
+				}
+			}
+		}
+	}
+	kill(child, SIGTERM);
+	if (wait(&status) < 0)
+		fatal("wait:");
+	return 0;
+}
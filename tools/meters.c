@@ -0,0 +1,99 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../arg.h"
+#include "../meters.h"
+#include "../util.h"
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: meters [-r rate] [-n count] meterfile\n");
+	exit(1);
+}
+
+static void
+printmeters(const char *name, const struct meter *m, size_t len)
+{
+	size_t i;
+
+	printf("%-8s", name);
+	for (i = 0; i < len; ++i)
+		printf(" %4.0f%s", m[i].peak < -99 ? -99 : m[i].peak, m[i].clip ? "!" : "");
+	putchar('\n');
+}
+
+int
+main(int argc, char *argv[])
+{
+	const struct meterhdr *hdr;
+	struct meter *meters;
+	struct timespec delay;
+	struct stat st;
+	uint64_t frame, last;
+	size_t len;
+	long rate, count;
+	int fd;
+
+	rate = 10;
+	count = -1;
+	ARGBEGIN {
+	case 'r':
+		rate = strtol(EARGF(usage()), NULL, 10);
+		if (rate <= 0)
+			usage();
+		break;
+	case 'n':
+		count = strtol(EARGF(usage()), NULL, 10);
+		break;
+	default:
+		usage();
+	} ARGEND
+	if (argc != 1)
+		usage();
+
+	fd = open(argv[0], O_RDONLY);
+	if (fd < 0)
+		fatal("open %s:", argv[0]);
+	if (fstat(fd, &st) != 0)
+		fatal("stat %s:", argv[0]);
+	if (st.st_size < sizeof *hdr)
+		fatal("%s: not a meter file", argv[0]);
+	hdr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (hdr == MAP_FAILED)
+		fatal("mmap %s:", argv[0]);
+	close(fd);
+	if (memcmp(hdr->magic, METERMAGIC, sizeof hdr->magic) != 0 || hdr->version != METERVERSION)
+		fatal("%s: not a meter file", argv[0]);
+	len = hdr->inputslen + 2 * hdr->outputslen;
+	if (sizeof *hdr + len * sizeof *meters > st.st_size)
+		fatal("%s: truncated meter file", argv[0]);
+	meters = calloc(len, sizeof *meters);
+	if (!meters)
+		fatal("calloc:");
+
+	delay.tv_sec = 1 / rate;
+	delay.tv_nsec = rate > 1 ? 1000000000 / rate : 0;
+	last = 0;
+	while (count != 0) {
+		frame = meterread(hdr, meters, len);
+		if (frame != last) {
+			last = frame;
+			printf("%.*s frame %llu\n", (int)sizeof hdr->device, hdr->device, (unsigned long long)frame);
+			printmeters("input", meters, hdr->inputslen);
+			printmeters("playback", meters + hdr->inputslen, hdr->outputslen);
+			printmeters("output", meters + hdr->inputslen + hdr->outputslen, hdr->outputslen);
+			fflush(stdout);
+			if (count > 0)
+				--count;
+		}
+		nanosleep(&delay, NULL);
+	}
+	return 0;
+}
@@ -0,0 +1,248 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../arg.h"
+#include "../intpack.h"
+#include "../oscmix.h"
+#include "../record.h"
+#include "../util.h"
+
+struct rec {
+	uint_least64_t time;
+	int type;
+	int dev;
+	const unsigned char *data;
+	size_t len;
+};
+
+static int rflag;
+static int vflag;
+static struct rec *recs;
+static size_t recslen;
+/* next recorded output to compare against */
+static size_t out;
+static unsigned long mismatches;
+static struct mixer *mixers[256];
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: replay [-rv] recfile\n");
+	exit(1);
+}
+
+static void
+addrec(uint_least64_t time, int type, int dev, const unsigned char *data, size_t len)
+{
+	static size_t cap;
+
+	if (recslen == cap) {
+		cap = cap ? cap * 2 : 1024;
+		recs = realloc(recs, cap * sizeof *recs);
+		if (!recs)
+			fatal(NULL);
+	}
+	recs[recslen].time = time;
+	recs[recslen].type = type;
+	recs[recslen].dev = dev;
+	recs[recslen].data = data;
+	recs[recslen].len = len;
+	++recslen;
+}
+
+static void
+parsenative(const unsigned char *pos, const unsigned char *end)
+{
+	size_t len;
+
+	pos += 12;
+	while (end - pos >= RECHDRLEN) {
+		len = getle32(pos + 12);
+		if (len > end - pos - RECHDRLEN)
+			fatal("truncated record");
+		addrec(getle64(pos), pos[8], pos[9], pos + RECHDRLEN, len);
+		pos += RECHDRLEN + len;
+	}
+}
+
+static void
+parsepcapng(const unsigned char *pos, const unsigned char *end)
+{
+	unsigned long type;
+	size_t len, caplen;
+
+	while (end - pos >= 12) {
+		type = getle32(pos);
+		len = getle32(pos + 4);
+		if (len < 12 || len > end - pos)
+			fatal("truncated block");
+		/* enhanced packet blocks hold the type and device, then the message */
+		if (type == 6 && len >= 36) {
+			caplen = getle32(pos + 20);
+			if (caplen < 4 || caplen > len - 32)
+				fatal("invalid packet length");
+			addrec((uint_least64_t)getle32(pos + 12) << 32 | getle32(pos + 16), pos[28], pos[29], pos + 32, caplen - 4);
+		}
+		pos += len;
+	}
+}
+
+/* /stats bundles report timings, so differ from run to run */
+static int
+isstats(int type, const unsigned char *buf, size_t len)
+{
+	return type == REC_OSCOUT && len > 27 && memcmp(buf + 20, "/stats", 6) == 0 && (buf[26] == '/' || buf[26] == '\0');
+}
+
+/* recorded output that replay must reproduce */
+static int
+isoutput(const struct rec *r)
+{
+	return (r->type == REC_MIDIOUT || r->type == REC_OSCOUT) && !isstats(r->type, r->data, r->len);
+}
+
+static void
+check(int type, int dev, const void *buf, size_t len)
+{
+	struct rec *r;
+
+	if (isstats(type, buf, len))
+		return;
+	while (out < recslen && !isoutput(&recs[out]))
+		++out;
+	if (out == recslen) {
+		++mismatches;
+		if (vflag)
+			fprintf(stderr, "unexpected output after end of recording\n");
+		return;
+	}
+	r = &recs[out++];
+	if (r->type != type || r->dev != dev || r->len != len || memcmp(r->data, buf, len) != 0) {
+		++mismatches;
+		if (vflag)
+			fprintf(stderr, "record %zu: output differs\n", out - 1);
+	}
+}
+
+void
+writemidi(void *arg, const void *buf, size_t len)
+{
+	check(REC_MIDIOUT, (int)(intptr_t)arg, buf, len);
+}
+
+void
+writeosc(const void *buf, size_t len)
+{
+	check(REC_OSCOUT, 0, buf, len);
+}
+
+static uint_least64_t
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint_least64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int
+main(int argc, char *argv[])
+{
+	static uint32_t payload[8192 / 4];
+	FILE *fp;
+	unsigned char *buf;
+	size_t len, cap, i;
+	uint_least64_t start, elapsed, wait;
+	struct rec *r;
+	char port[64];
+	struct timespec ts;
+
+	ARGBEGIN {
+	case 'r':
+		rflag = 1;
+		break;
+	case 'v':
+		vflag = 1;
+		break;
+	default:
+		usage();
+	} ARGEND
+	if (argc != 1)
+		usage();
+
+	fp = fopen(argv[0], "rb");
+	if (!fp)
+		fatal("open %s:", argv[0]);
+	buf = NULL;
+	len = 0;
+	cap = 0;
+	do {
+		if (len == cap) {
+			cap = cap ? cap * 2 : 1 << 16;
+			buf = realloc(buf, cap);
+			if (!buf)
+				fatal(NULL);
+		}
+		len += fread(buf + len, 1, cap - len, fp);
+	} while (!feof(fp) && !ferror(fp));
+	if (ferror(fp))
+		fatal("read %s:", argv[0]);
+	fclose(fp);
+	if (len >= 12 && memcmp(buf, "OSCMIXRC", 8) == 0)
+		parsenative(buf, buf + len);
+	else if (len >= 12 && getle32(buf) == 0x0A0D0D0A)
+		parsepcapng(buf, buf + len);
+	else
+		fatal("%s: unknown format", argv[0]);
+
+	start = now();
+	for (i = 0; i < recslen; ++i) {
+		r = &recs[i];
+		if (rflag && r->time - recs[0].time > now() - start) {
+			wait = r->time - recs[0].time - (now() - start);
+			ts.tv_sec = wait / 1000000000;
+			ts.tv_nsec = wait % 1000000000;
+			nanosleep(&ts, NULL);
+		}
+		if (r->type != REC_DEVICE && r->type != REC_OSCIN && r->type != REC_TIMER && !mixers[r->dev])
+			continue;
+		switch (r->type) {
+		case REC_DEVICE:
+			snprintf(port, sizeof port, "%.*s", (int)r->len, (const char *)r->data);
+			mixers[r->dev] = newmixer(port, (void *)(intptr_t)r->dev);
+			if (!mixers[r->dev])
+				exit(1);
+			break;
+		case REC_MIDIIN:
+			if (r->len <= sizeof payload)
+				handlesysex(mixers[r->dev], r->data, r->len, payload);
+			break;
+		case REC_OSCIN:
+			handleosc(r->data, r->len);
+			break;
+		case REC_TIMER:
+			handletimer(r->len > 0 && r->data[0]);
+			break;
+		case REC_CONNECT:
+			handleconnect(mixers[r->dev], r->len > 0 && r->data[0]);
+			break;
+		case REC_LOST:
+			handlelost(mixers[r->dev]);
+			break;
+		}
+	}
+	elapsed = now() - start;
+	/* recorded output that was never produced */
+	for (; out < recslen; ++out) {
+		if (isoutput(&recs[out]))
+			++mismatches;
+	}
+	printf("records %zu\nmismatches %lu\nseconds %.6f\nrecords/s %.0f\n",
+		recslen, mismatches, elapsed / 1e9, recslen / (elapsed / 1e9));
+	return mismatches != 0;
+}
@@ -507,3 +507,47 @@ local usb_table = DissectorTable.get('usb.product')
 usb_table:add(0x2a393f82, rme_proto)  -- UCX II
 usb_table:add(0x2a393fcd, rme_proto)  -- 802
 usb_table:add(0x2a393fc9, rme_proto)  -- UCX
+
+-- oscmix recordings (oscmix -w file.pcapng)
+local oscmix_proto = Proto('oscmix', 'oscmix Recording')
+local pf_rectype = ProtoField.uint8('oscmix.type', 'Type', base.DEC, {
+	[0]='SysEx from device',
+	[1]='SysEx to device',
+	[2]='OSC in',
+	[3]='OSC out',
+	[4]='Device',
+	[5]='Timer',
+	[6]='Connect',
+	[7]='Lost',
+	[8]='OSC repair',
+})
+local pf_recdev = ProtoField.uint8('oscmix.dev', 'Device', base.DEC)
+oscmix_proto.fields = {pf_rectype, pf_recdev}
+local osc_dissector = Dissector.get('osc')
+
+function oscmix_proto.dissector(buffer, pinfo, tree)
+	pinfo.cols.protocol = oscmix_proto.name
+	local subtree = tree:add(oscmix_proto, buffer(0, 4), 'oscmix Recording')
+	local rectype = buffer(0, 1):uint()
+	subtree:add(pf_rectype, buffer(0, 1))
+	subtree:add(pf_recdev, buffer(1, 1))
+	if buffer:len() <= 4 then
+		return
+	end
+	local data = buffer(4)
+	if rectype == 0 or rectype == 1 then
+		-- skip F0 and the manufacturer ID, and the trailing F7
+		if data:len() > 5 and data(0, 4):uint() == 0xf000200d then
+			sysex_rme_proto.dissector(data(4, data:len() - 5):tvb(), pinfo, tree)
+		end
+	elseif rectype == 2 or rectype == 3 or rectype == 8 then
+		osc_dissector:call(data:tvb(), pinfo, tree)
+	elseif rectype == 4 then
+		pinfo.cols.info = 'Device '..data:string()
+	end
+end
+
+local wtap_table = DissectorTable.get('wtap_encap')
+if wtap_table then
+	wtap_table:add(wtap.USER0, oscmix_proto)
+end
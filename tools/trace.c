@@ -0,0 +1,190 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../arg.h"
+#include "../device.h"
+#include "../trace.h"
+#include "../util.h"
+
+static const char *const ctlnames[NUMCTLS] = {
+#define X(name) #name,
+	CONTROLS(X)
+#undef X
+};
+
+static const char *const typenames[NUMTRACES] = {
+	[TRACE_SETREG] = "setreg",
+	[TRACE_DEVREG] = "devreg",
+	[TRACE_SYSEXIN] = "sysexin",
+	[TRACE_OSCIN] = "oscin",
+	[TRACE_OSCOUT] = "oscout",
+	[TRACE_TIMER] = "timer",
+	[TRACE_CONNECT] = "connect",
+	[TRACE_LOST] = "lost",
+};
+
+static const struct device *tracedevs[TRACEDEVS];
+static uint64_t start;
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: trace [-f] [-n count] tracefile\n");
+	exit(1);
+}
+
+/* describes a register using the register map of the device */
+static void
+regname(const struct device *device, int reg, char *buf, size_t len)
+{
+	const struct regmap *map;
+	int off, in, out, ins;
+
+	if (reg == 0x3F00) {
+		snprintf(buf, len, "SERIAL");
+		return;
+	}
+	for (map = device->regmap; map != device->regmap + device->regmaplen; ++map) {
+		off = reg - map->reg;
+		if (off < 0 || (unsigned)map->ctl >= NUMCTLS || map->ctl == UNKNOWN)
+			continue;
+		ins = map->flags & REG_INPUT ? device->inputslen : map->flags & REG_PLAYBACK ? device->outputslen : 0;
+		if (map->flags & (REG_INPUT | REG_PLAYBACK) && map->flags & REG_OUTPUT) {
+			out = off / map->stride;
+			in = off % map->stride;
+			if (out < device->outputslen && in < ins) {
+				snprintf(buf, len, "%s out %d in %d", ctlnames[map->ctl], out + 1, in + 1);
+				return;
+			}
+		} else if (map->flags & (REG_INPUT | REG_PLAYBACK | REG_OUTPUT)) {
+			if (map->stride == 0 || off % map->stride != 0)
+				continue;
+			in = off / map->stride;
+			if (map->flags & REG_PAIR)
+				in *= 2;
+			if (in < (map->flags & REG_OUTPUT ? device->outputslen : ins)) {
+				snprintf(buf, len, "%s %s %d", ctlnames[map->ctl], map->flags & REG_OUTPUT ? "out" : "in", in + 1);
+				return;
+			}
+		} else if (off == 0) {
+			snprintf(buf, len, "%s", ctlnames[map->ctl]);
+			return;
+		}
+	}
+	snprintf(buf, len, "?");
+}
+
+static void
+print(const struct traceent *e)
+{
+	const struct device *device;
+	char name[64];
+
+	if (!start)
+		start = e->time;
+	printf("%12.6f %d %-8s", (e->time - start) / 1e9, e->dev, e->type < NUMTRACES ? typenames[e->type] : "?");
+	switch (e->type) {
+	case TRACE_SETREG:
+	case TRACE_DEVREG:
+		device = e->dev < TRACEDEVS ? tracedevs[e->dev] : NULL;
+		if (device)
+			regname(device, e->reg, name, sizeof name);
+		else
+			snprintf(name, sizeof name, "?");
+		printf(" %.4X=%.4X %-28s %d", e->reg, (unsigned)e->val & 0xffff, name, (int16_t)e->val);
+		break;
+	case TRACE_SYSEXIN:
+		printf(" subid %d len %lu", e->reg, (unsigned long)e->val);
+		break;
+	case TRACE_OSCIN:
+	case TRACE_OSCOUT:
+		printf(" len %lu", (unsigned long)e->val);
+		break;
+	case TRACE_TIMER:
+		printf(" levels %lu", (unsigned long)e->val);
+		break;
+	case TRACE_CONNECT:
+		printf(" %s", e->val ? "connected" : "disconnected");
+		break;
+	}
+	putchar('\n');
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const struct timespec delay = {0, 100000000};
+	const struct tracehdr *hdr;
+	const struct traceent *ring;
+	struct stat st;
+	uint64_t pos, end, count;
+	bool fflag;
+	size_t i, j;
+	int fd;
+
+	fflag = false;
+	count = UINT64_MAX;
+	ARGBEGIN {
+	case 'f':
+		fflag = true;
+		break;
+	case 'n':
+		count = strtoull(EARGF(usage()), NULL, 10);
+		break;
+	default:
+		usage();
+	} ARGEND
+	if (argc != 1)
+		usage();
+
+	fd = open(argv[0], O_RDONLY);
+	if (fd < 0)
+		fatal("open %s:", argv[0]);
+	if (fstat(fd, &st) != 0)
+		fatal("stat %s:", argv[0]);
+	if (st.st_size < sizeof *hdr)
+		fatal("%s: not a trace", argv[0]);
+	hdr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (hdr == MAP_FAILED)
+		fatal("mmap %s:", argv[0]);
+	close(fd);
+	if (memcmp(hdr->magic, TRACEMAGIC, sizeof hdr->magic) != 0 || hdr->version != TRACEVERSION)
+		fatal("%s: not a trace", argv[0]);
+	if (hdr->len == 0 || (hdr->len & (hdr->len - 1)) != 0 || tracesize(hdr->len) > st.st_size)
+		fatal("%s: invalid trace length", argv[0]);
+	ring = (const struct traceent *)(hdr + 1);
+	for (i = 0; i < TRACEDEVS; ++i) {
+		for (j = 0; j < deviceslen; ++j) {
+			if (strncmp(hdr->devices[i], devices[j]->id, sizeof hdr->devices[i]) == 0)
+				tracedevs[i] = devices[j];
+		}
+	}
+
+	end = hdr->pos;
+	pos = end > hdr->len ? end - hdr->len : 0;
+	if (end - pos > count)
+		pos = end - count;
+	for (;;) {
+		for (; pos < end; ++pos)
+			print(&ring[pos & (hdr->len - 1)]);
+		if (!fflag)
+			break;
+		fflush(stdout);
+		nanosleep(&delay, NULL);
+		end = hdr->pos;
+		if (end - pos > hdr->len) {
+			printf("%llu entries overwritten\n", (unsigned long long)(end - pos - hdr->len));
+			pos = end - hdr->len;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,328 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "../arg.h"
+#include "../socket.h"
+#include "../util.h"
+#include "../ws.h"
+
+#define LEN(a) (sizeof (a) / sizeof *(a))
+
+enum direction {
+	DOWN,  /* datagrams from oscmix until every client has the frame */
+	UP,    /* frames from the clients until the datagram arrives */
+};
+
+/* frames in flight; enough to keep the bridge busy without overflowing UDP buffers */
+#define WINDOW 64
+
+struct client {
+	int fd;
+	unsigned long frames;
+	unsigned char buf[WS_HDRMAX + 65536];
+	size_t buflen;
+};
+
+static char *wshost, *wsport;
+static int oscin, oscout;
+static struct client clients[64];
+static unsigned char payload[65000];
+static pid_t child;
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: wsbench [-n frames] [-c clients,...] [-b bytes,...] [-r addr] [-s addr] [-w addr] cmd [arg...]\n");
+	exit(1);
+}
+
+static uint_least64_t
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint_least64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int
+tcpconnect(void)
+{
+	struct addrinfo hint, *ais, *ai;
+	int err, fd;
+
+	memset(&hint, 0, sizeof hint);
+	hint.ai_family = AF_UNSPEC;
+	hint.ai_socktype = SOCK_STREAM;
+	err = getaddrinfo(wshost, wsport, &hint, &ais);
+	if (err != 0)
+		fatal("getaddrinfo: %s", gai_strerror(err));
+	fd = -1;
+	for (ai = ais; ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		if (fd >= 0)
+			close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(ais);
+	return fd;
+}
+
+/* connects and upgrades a client, retrying while the bridge starts up */
+static void
+wsconnect(struct client *c)
+{
+	static const char request[] =
+		"GET / HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+		"Sec-WebSocket-Version: 13\r\n"
+		"\r\n";
+	static const char accept[] = "HTTP/1.1 101 ";
+	uint_least64_t deadline;
+	char resp[1024];
+	size_t len;
+
+	deadline = now() + 3000000000;
+	while ((c->fd = tcpconnect()) < 0) {
+		if (now() > deadline)
+			fatal("connect %s!%s:", wshost, wsport);
+		nanosleep(&(struct timespec){.tv_nsec = 10000000}, NULL);
+	}
+	setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+	if (write(c->fd, request, sizeof request - 1) != sizeof request - 1)
+		fatal("write:");
+	/* read a byte at a time so no frame is consumed with the response */
+	for (len = 0; len < 4 || memcmp(resp + len - 4, "\r\n\r\n", 4) != 0; ++len) {
+		if (len == sizeof resp || read(c->fd, resp + len, 1) != 1)
+			fatal("WebSocket handshake failed");
+	}
+	if (memcmp(resp, accept, sizeof accept - 1) != 0)
+		fatal("WebSocket upgrade refused: %.*s", (int)(strchr(resp, '\r') - resp), resp);
+	c->frames = 0;
+	c->buflen = 0;
+}
+
+/* counts the complete frames available from a client */
+static void
+readframes(struct client *c)
+{
+	struct wsframe f;
+	unsigned char *pos, *end;
+	size_t hdrlen;
+	ssize_t ret;
+
+	ret = read(c->fd, c->buf + c->buflen, sizeof c->buf - c->buflen);
+	if (ret <= 0)
+		fatal(ret < 0 ? "read:" : "WebSocket connection closed");
+	c->buflen += ret;
+	pos = c->buf;
+	end = c->buf + c->buflen;
+	while ((hdrlen = wsframeparse(pos, end - pos, &f)) > 0 && f.len <= end - pos - hdrlen) {
+		if (f.op == WS_CLOSE)
+			fatal("WebSocket connection closed by server");
+		if (f.op == WS_BINARY)
+			++c->frames;
+		pos += hdrlen + f.len;
+	}
+	c->buflen = end - pos;
+	memmove(c->buf, pos, c->buflen);
+}
+
+/* measures one direction at one load level and prints a report line */
+static void
+run(enum direction dir, unsigned long frames, size_t nclients, size_t size)
+{
+	static const char *const names[] = {"down", "up"};
+	static unsigned char frame[WS_HDRMAX + sizeof payload], dgram[sizeof payload];
+	struct pollfd pfd[LEN(clients) + 1];
+	unsigned long sent, done, total, lost;
+	unsigned char key[4] = {0x12, 0x34, 0x56, 0x78};
+	size_t i, framelen;
+	uint_least64_t start, elapsed;
+	int ret;
+
+	for (i = 0; i < nclients; ++i)
+		wsconnect(&clients[i]);
+	/* a masked frame, built once and sent by every client */
+	framelen = wsframehdr(frame, WS_BINARY, size);
+	frame[1] |= 0x80;
+	memcpy(frame + framelen, key, sizeof key);
+	framelen += sizeof key;
+	memcpy(frame + framelen, payload, size);
+	wsunmask(frame + framelen, size, key);
+	framelen += size;
+
+	sent = 0;
+	done = 0;
+	total = 0;
+	start = now();
+	while (done < frames) {
+		for (; sent < frames && sent - done < WINDOW; ++sent) {
+			if (dir == DOWN) {
+				if (write(oscout, payload, size) < 0 && errno != ECONNREFUSED)
+					fatal("write:");
+			} else if (write(clients[sent % nclients].fd, frame, framelen) != framelen) {
+				fatal("write:");
+			}
+		}
+		for (i = 0; i < nclients; ++i) {
+			pfd[i].fd = clients[i].fd;
+			pfd[i].events = POLLIN;
+		}
+		pfd[i].fd = oscin;
+		pfd[i].events = POLLIN;
+		/* anything not delivered within a second is lost */
+		ret = poll(pfd, nclients + 1, 1000);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			fatal("poll:");
+		}
+		if (ret == 0)
+			break;
+		for (i = 0; i < nclients; ++i) {
+			if (pfd[i].revents & (POLLIN | POLLHUP | POLLERR))
+				readframes(&clients[i]);
+		}
+		if (pfd[nclients].revents & POLLIN) {
+			while (recv(oscin, dgram, sizeof dgram, MSG_DONTWAIT) >= 0)
+				++total;
+		}
+		if (dir == DOWN) {
+			/* a datagram is done once every client has it */
+			done = clients[0].frames;
+			total = 0;
+			for (i = 0; i < nclients; ++i) {
+				if (clients[i].frames < done)
+					done = clients[i].frames;
+				total += clients[i].frames;
+			}
+		} else {
+			done = total;
+		}
+	}
+	elapsed = now() - start;
+	lost = dir == DOWN ? frames * nclients - total : frames - total;
+	printf("%s\t%zu\t%zu\t%lu\t%lu\t%.0f\t%.1f\n",
+		names[dir], nclients, size, total, lost,
+		total / (elapsed / 1e9), total * size / (elapsed / 1e3));
+	fflush(stdout);
+	for (i = 0; i < nclients; ++i)
+		close(clients[i].fd);
+	/* let the bridge notice the closed connections */
+	nanosleep(&(struct timespec){.tv_nsec = 100000000}, NULL);
+}
+
+static size_t
+parselist(char *str, unsigned long *list, size_t len)
+{
+	char *end;
+	size_t n;
+
+	for (n = 0; n < len; ++n) {
+		list[n] = strtoul(str, &end, 10);
+		if (end == str || (*end && *end != ','))
+			usage();
+		if (!*end)
+			return n + 1;
+		str = end + 1;
+	}
+	usage();
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	static char recvaddr[256] = "udp!127.0.0.1!7222";
+	static char sendaddr[256] = "udp!127.0.0.1!8222";
+	static char wsaddr[256] = "tcp!127.0.0.1!8222";
+	unsigned long nclients[16] = {1, 4, 16}, sizes[16] = {64, 1024};
+	size_t nclientsl = 3, sizesl = 2, i, j, k;
+	unsigned long frames;
+	char *sep;
+	int status;
+
+	frames = 100000;
+	ARGBEGIN {
+	case 'n':
+		frames = strtoul(EARGF(usage()), NULL, 10);
+		break;
+	case 'c':
+		nclientsl = parselist(EARGF(usage()), nclients, LEN(nclients));
+		break;
+	case 'b':
+		sizesl = parselist(EARGF(usage()), sizes, LEN(sizes));
+		break;
+	case 'r':
+		snprintf(recvaddr, sizeof recvaddr, "%s", EARGF(usage()));
+		break;
+	case 's':
+		snprintf(sendaddr, sizeof sendaddr, "%s", EARGF(usage()));
+		break;
+	case 'w':
+		snprintf(wsaddr, sizeof wsaddr, "%s", EARGF(usage()));
+		break;
+	default:
+		usage();
+	} ARGEND
+	if (argc < 1 || frames == 0)
+		usage();
+	for (i = 0; i < nclientsl; ++i) {
+		if (nclients[i] < 1 || nclients[i] > LEN(clients))
+			fatal("clients must be between 1 and %zu", LEN(clients));
+	}
+	for (i = 0; i < sizesl; ++i) {
+		if (sizes[i] > sizeof payload)
+			fatal("frames must be at most %zu bytes", sizeof payload);
+	}
+	if (strncmp(wsaddr, "tcp!", 4) != 0 || !(sep = strchr(wsaddr + 4, '!')))
+		fatal("WebSocket address must have the form tcp!host!port");
+	*sep = '\0';
+	wshost = wsaddr + 4;
+	wsport = sep + 1;
+	for (i = 0; i < sizeof payload; ++i)
+		payload[i] = i;
+
+	oscin = sockopen(recvaddr, 1, NULL);
+	oscout = sockopen(sendaddr, 0, NULL);
+	signal(SIGPIPE, SIG_IGN);
+	child = fork();
+	if (child < 0)
+		fatal("fork:");
+	if (child == 0) {
+		execvp(argv[0], argv);
+		fatal("exec %s:", argv[0]);
+	}
+
+	printf("direction\tclients\tbytes\tframes\tlost\tframes_per_s\tMB_per_s\n");
+	for (i = 0; i < sizesl; ++i) {
+		for (j = 0; j < nclientsl; ++j) {
+			for (k = 0; k < 2; ++k)
+				run(k, frames, nclients[j], sizes[i]);
+		}
+	}
+	kill(child, SIGTERM);
+	if (wait(&status) < 0)
+		fatal("wait:");
+	return 0;
+}
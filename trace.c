@@ -0,0 +1,53 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "trace.h"
+
+static struct tracehdr *hdr;
+static struct traceent *ring;
+
+size_t
+tracesize(size_t len)
+{
+	return sizeof *hdr + len * sizeof *ring;
+}
+
+/* starts an empty trace of len entries in mem, usually a shared mapping */
+void
+traceinit(void *mem, size_t len)
+{
+	hdr = mem;
+	ring = (struct traceent *)(hdr + 1);
+	memset(hdr, 0, sizeof *hdr);
+	memcpy(hdr->magic, TRACEMAGIC, sizeof hdr->magic);
+	hdr->version = TRACEVERSION;
+	hdr->len = len;
+}
+
+void
+tracedevice(int dev, const char *id)
+{
+	if (hdr && dev >= 0 && dev < TRACEDEVS)
+		strncpy(hdr->devices[dev], id, sizeof hdr->devices[dev] - 1);
+}
+
+/* appends an event; only touches memory, so it is cheap enough to leave on */
+void
+trace(int type, int dev, int reg, unsigned long val)
+{
+	struct traceent *e;
+	struct timespec ts;
+
+	if (!hdr)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	e = &ring[hdr->pos & (hdr->len - 1)];
+	e->time = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	e->type = type;
+	e->dev = dev;
+	e->reg = reg;
+	e->val = val;
+	++hdr->pos;
+}
@@ -0,0 +1,44 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum {
+	TRACE_SETREG,   /* register written by oscmix */
+	TRACE_DEVREG,   /* register reported by the device */
+	TRACE_SYSEXIN,  /* reg is the sub ID, val the length */
+	TRACE_OSCIN,    /* val is the length */
+	TRACE_OSCOUT,   /* val is the length */
+	TRACE_TIMER,
+	TRACE_CONNECT,  /* val is whether the device is connected */
+	TRACE_LOST,
+	NUMTRACES,
+};
+
+struct traceent {
+	uint64_t time;  /* CLOCK_MONOTONIC, in ns */
+	uint8_t type;
+	uint8_t dev;    /* device number, or 0 if not specific to one */
+	uint16_t reg;
+	uint32_t val;
+};
+
+#define TRACEMAGIC "OSCMIXTR"
+#define TRACEVERSION 1
+#define TRACEDEVS 16
+
+struct tracehdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t len;                 /* number of entries, a power of two */
+	uint64_t pos;                 /* entries written so far */
+	char devices[TRACEDEVS][32];  /* device ID of each device number */
+};
+
+size_t tracesize(size_t len);
+void traceinit(void *mem, size_t len);
+void tracedevice(int dev, const char *id);
+void trace(int type, int dev, int reg, unsigned long val);
+
+#endif
@@ -107,7 +107,7 @@ class ConnectionMIDI extends AbortController {
 					if (this.recv)
 						this.recv(instance.exports.memory.buffer, buf, len);
 				}.bind(this),
-				writemidi(buf, len) {
+				writemidi(arg, buf, len) {
 					output.send(new Uint8Array(instance.exports.memory.buffer, buf, len));
 				},
 			},
@@ -154,7 +154,8 @@ class ConnectionMIDI extends AbortController {
 			const { read } = new TextEncoder().encodeInto(input.name + '\0', name);
 			if (read < input.name.length + 1)
 				throw Error('MIDI port name is too long');
-			if (instance.exports.init(jsdata) != 0)
+			const mixer = instance.exports.newmixer(jsdata, 0);
+			if (mixer == 0)
 				throw Error('oscmix init failed');
 			input.addEventListener('midimessage', (event) => {
 				if (event.data[0] != 0xf0 || event.data[event.data.length - 1] != 0xf7)
@@ -165,7 +166,7 @@ class ConnectionMIDI extends AbortController {
 				}
 				const sysex = new Uint8Array(instance.exports.memory.buffer, jsdata, event.data.length);
 				sysex.set(event.data);
-				instance.exports.handlesysex(sysex.byteOffset, sysex.byteLength, jsdata);
+				instance.exports.handlesysex(mixer, sysex.byteOffset, sysex.byteLength, jsdata);
 			}, {signal: this.signal});
 			const stateHandler = (event) => {
 				if (event.target.state == 'disconnected')
@@ -822,6 +823,9 @@ function setupInterface() {
 
 	let connection;
 	const connectionForm = document.getElementById('connection');
+	/* served by oscmix -W, the WebSocket is on the same port */
+	if (location.protocol == 'http:')
+		connectionForm.elements['connection-websocket-address'].value = 'ws://' + location.host;
 	connectionForm.addEventListener('submit', (event) => {
 		event.preventDefault();
 		if (connection)
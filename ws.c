@@ -0,0 +1,235 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "base64.h"
+#include "http.h"
+#include "intpack.h"
+#include "sha1.h"
+#include "ws.h"
+
+static bool
+hastoken(char *value, const char *token)
+{
+	char *tok, *end;
+
+	for (tok = strtok_r(value, " \t,", &end); tok; tok = strtok_r(NULL, " \t,", &end)) {
+		if (strcasecmp(tok, token) == 0)
+			return true;
+	}
+	return false;
+}
+
+static char *
+trim(char *s)
+{
+	char *end;
+
+	while (*s == ' ' || *s == '\t')
+		++s;
+	end = s + strlen(s);
+	while (end > s && (end[-1] == ' ' || end[-1] == '\t'))
+		--end;
+	*end = '\0';
+	return s;
+}
+
+/* accepts the first permessage-deflate offer with parameters we can honor */
+static void
+deflateoffer(struct wsrequest *req, char *value)
+{
+	char *offer, *param, *val, *end1, *end2;
+	bool notakeover, ok;
+	int bits;
+
+	for (offer = strtok_r(value, ",", &end1); offer && !req->deflate; offer = strtok_r(NULL, ",", &end1)) {
+		param = strtok_r(offer, ";", &end2);
+		if (!param || strcmp(trim(param), "permessage-deflate") != 0)
+			continue;
+		notakeover = false;
+		bits = 0;
+		ok = true;
+		while (ok && (param = strtok_r(NULL, ";", &end2))) {
+			val = strchr(param, '=');
+			if (val) {
+				*val++ = '\0';
+				val = trim(val);
+				if (*val == '"' && val[1] && val[strlen(val) - 1] == '"') {
+					val[strlen(val) - 1] = '\0';
+					++val;
+				}
+			}
+			param = trim(param);
+			if (strcmp(param, "server_no_context_takeover") == 0 && !val) {
+				notakeover = true;
+			} else if (strcmp(param, "server_max_window_bits") == 0 && val) {
+				/* zlib cannot produce raw deflate with a 256 byte window */
+				bits = strtol(val, &val, 10);
+				ok = *val == '\0' && bits >= 9 && bits <= 15;
+			} else if (strcmp(param, "client_no_context_takeover") != 0 && strcmp(param, "client_max_window_bits") != 0) {
+				ok = false;
+			}
+		}
+		if (ok) {
+			req->deflate = true;
+			req->servernotakeover = notakeover;
+			req->serverbits = bits;
+		}
+	}
+}
+
+/* handles one CRLF-terminated line; returns 1 after the last, 0 for more, or -1 */
+int
+wsrequestline(struct wsrequest *req, char *buf, size_t len)
+{
+	static const char guid[36] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+	struct http_request httpreq;
+	struct http_header hdr;
+	unsigned char sha1[20];
+	sha1_context ctx;
+	char *end;
+
+	if (req->lines++ == 0) {
+		if (http_request(buf, len, &httpreq) != 0 || httpreq.method != HTTP_GET)
+			return -1;
+		if (strlen(httpreq.uri) >= sizeof req->uri)
+			return -1;
+		strcpy(req->uri, httpreq.uri);
+		return 0;
+	}
+	if (http_header(buf, len, &hdr) != 0)
+		return -1;
+	if (!hdr.name)
+		return 1;
+	if (strcasecmp(hdr.name, "Upgrade") == 0) {
+		if (hastoken(hdr.value, "websocket"))
+			req->websocket = true;
+	} else if (strcasecmp(hdr.name, "Connection") == 0) {
+		if (hastoken(hdr.value, "Upgrade"))
+			req->upgrade = true;
+	} else if (strcasecmp(hdr.name, "Sec-WebSocket-Key") == 0) {
+		if (hdr.value_len != (16 + 2) / 3 * 4)
+			return -1;
+		sha1_init(&ctx);
+		sha1_update(&ctx, hdr.value, hdr.value_len);
+		sha1_update(&ctx, guid, sizeof guid);
+		sha1_out(&ctx, sha1);
+		base64_encode(req->accept, sha1, sizeof sha1);
+		req->havekey = true;
+	} else if (strcasecmp(hdr.name, "Sec-WebSocket-Extensions") == 0) {
+		deflateoffer(req, hdr.value);
+	} else if (strcasecmp(hdr.name, "Accept-Encoding") == 0) {
+		snprintf(req->encodings, sizeof req->encodings, "%s", hdr.value);
+	} else if (strcasecmp(hdr.name, "If-None-Match") == 0) {
+		snprintf(req->etags, sizeof req->etags, "%s", hdr.value);
+	} else if (strcasecmp(hdr.name, "Sec-WebSocket-Version") == 0) {
+		req->version = strtol(hdr.value, &end, 10);
+		if (hdr.value_len == 0 || hdr.value_len != end - hdr.value)
+			return -1;
+	}
+	return 0;
+}
+
+/* writes the response accepting a complete request; returns its length, or -1 */
+int
+wsresponse(struct wsrequest *req, char *buf, size_t len)
+{
+	char ext[128], bits[32];
+	int ret;
+
+	if (!req->upgrade || !req->websocket || !req->havekey || req->version != 13)
+		return -1;
+	if (wsdeflatelevel < 0)
+		req->deflate = false;
+	ext[0] = '\0';
+	if (req->deflate) {
+		bits[0] = '\0';
+		if (req->serverbits)
+			snprintf(bits, sizeof bits, "; server_max_window_bits=%d", req->serverbits);
+		snprintf(ext, sizeof ext, "Sec-WebSocket-Extensions: permessage-deflate%s%s\r\n",
+			req->servernotakeover ? "; server_no_context_takeover" : "", bits);
+	}
+	ret = snprintf(buf, len,
+		"HTTP/1.1 101 Switching Protocols\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Accept: %s\r\n"
+		"%s"
+		"\r\n", req->accept, ext);
+	return ret >= 0 && ret < len ? ret : -1;
+}
+
+/* writes the header of an unmasked final frame, and returns its length */
+size_t
+wsframehdr(unsigned char *hdr, int op, size_t len)
+{
+	hdr[0] = 0x80 | op;
+	if (len < 126) {
+		hdr[1] = len;
+		return 2;
+	}
+	if (len <= 0xffff) {
+		hdr[1] = 126;
+		putbe16(hdr + 2, len);
+		return 4;
+	}
+	hdr[1] = 127;
+	putbe64(hdr + 2, len);
+	return 10;
+}
+
+/* decodes a frame header; returns its length, or 0 if it is incomplete */
+size_t
+wsframeparse(const unsigned char *buf, size_t len, struct wsframe *f)
+{
+	size_t hdrlen;
+
+	if (len < 2)
+		return 0;
+	f->fin = buf[0] & 0x80;
+	f->rsv = buf[0] & 0x70;
+	f->op = buf[0] & 0xf;
+	f->masked = buf[1] & 0x80;
+	f->len = buf[1] & 0x7f;
+	hdrlen = 2;
+	if (f->len == 126) {
+		if (len < 4)
+			return 0;
+		f->len = getbe16(buf + 2);
+		hdrlen = 4;
+	} else if (f->len == 127) {
+		if (len < 10)
+			return 0;
+		f->len = getbe64(buf + 2);
+		hdrlen = 10;
+	}
+	if (f->masked) {
+		if (len < hdrlen + 4)
+			return 0;
+		memcpy(f->key, buf + hdrlen, 4);
+		hdrlen += 4;
+	}
+	return hdrlen;
+}
+
+void
+wsunmask(unsigned char *buf, size_t len, const unsigned char key[static 4])
+{
+	unsigned char key8[8];
+	uint64_t mask, word;
+	size_t i;
+
+	/* eight bytes at a time; the key repeats every four */
+	memcpy(key8, key, 4);
+	memcpy(key8 + 4, key, 4);
+	memcpy(&mask, key8, sizeof mask);
+	for (i = 0; i + 8 <= len; i += 8) {
+		memcpy(&word, buf + i, sizeof word);
+		word ^= mask;
+		memcpy(buf + i, &word, sizeof word);
+	}
+	for (; i < len; ++i)
+		buf[i] ^= key[i & 3];
+}
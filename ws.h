@@ -0,0 +1,64 @@
+#ifndef WS_H
+#define WS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum {
+	WS_CONT = 0x0,
+	WS_TEXT = 0x1,
+	WS_BINARY = 0x2,
+	WS_CLOSE = 0x8,
+	WS_PING = 0x9,
+	WS_PONG = 0xa,
+};
+
+/* set on the first frame of a compressed message */
+#define WS_RSV1 0x40
+
+/* largest frame header */
+#define WS_HDRMAX 14
+
+/* state of an HTTP request, zeroed and fed one line at a time */
+struct wsrequest {
+	int lines;
+	/* for a request that is not an upgrade */
+	char uri[256], encodings[128], etags[256];
+	bool upgrade, websocket, havekey;
+	long version;
+	char accept[29];
+	/* the permessage-deflate offer that was accepted */
+	bool deflate, servernotakeover;
+	int serverbits;
+};
+
+struct wsframe {
+	int op;
+	int rsv;
+	bool fin, masked;
+	unsigned char key[4];
+	uint64_t len;
+};
+
+/* permessage-deflate state of a connection */
+struct wsdeflate;
+
+/* compression level offered to clients, or -1 to refuse compression */
+extern int wsdeflatelevel;
+/* whether oscmix was built with zlib */
+extern const bool wsdeflatesupported;
+
+int wsrequestline(struct wsrequest *req, char *buf, size_t len);
+int wsresponse(struct wsrequest *req, char *buf, size_t len);
+size_t wsframehdr(unsigned char *hdr, int op, size_t len);
+size_t wsframeparse(const unsigned char *buf, size_t len, struct wsframe *f);
+void wsunmask(unsigned char *buf, size_t len, const unsigned char key[static 4]);
+
+void wsdeflateinit(const char *opt);
+struct wsdeflate *wsdeflatenew(const struct wsrequest *req);
+void wsdeflatefree(struct wsdeflate *z);
+const unsigned char *wsdeflate(struct wsdeflate *z, const unsigned char *buf, size_t *len);
+long wsinflate(struct wsdeflate *z, const unsigned char *buf, size_t len, unsigned char *out, size_t outlen);
+
+#endif
@@ -0,0 +1,132 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "util.h"
+#include "ws.h"
+
+struct wsdeflate {
+	z_stream def, inf;
+	bool notakeover;
+	unsigned char *buf;
+	size_t bufcap;
+};
+
+int wsdeflatelevel = -1;
+const bool wsdeflatesupported = true;
+/* smaller messages are sent uncompressed */
+static size_t deflatemin;
+
+/* parses level[,minbytes] */
+void
+wsdeflateinit(const char *opt)
+{
+	char *end;
+	long level;
+
+	level = strtol(opt, &end, 10);
+	if (end == opt || level < 0 || level > 9)
+		fatal("invalid deflate level '%s'", opt);
+	deflatemin = 32;
+	if (*end == ',') {
+		opt = end + 1;
+		deflatemin = strtoul(opt, &end, 10);
+		if (end == opt)
+			fatal("invalid deflate threshold '%s'", opt);
+	}
+	if (*end)
+		fatal("invalid deflate option '%s'", opt);
+	wsdeflatelevel = level;
+}
+
+struct wsdeflate *
+wsdeflatenew(const struct wsrequest *req)
+{
+	struct wsdeflate *z;
+
+	z = calloc(1, sizeof *z);
+	if (!z)
+		fatal("calloc:");
+	/* negative window bits select raw deflate, without a zlib header */
+	if (deflateInit2(&z->def, wsdeflatelevel, Z_DEFLATED, -(req->serverbits ? req->serverbits : 15), 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		fatal("deflateInit2 failed");
+	if (inflateInit2(&z->inf, -15) != Z_OK)
+		fatal("inflateInit2 failed");
+	z->notakeover = req->servernotakeover;
+	return z;
+}
+
+void
+wsdeflatefree(struct wsdeflate *z)
+{
+	if (!z)
+		return;
+	deflateEnd(&z->def);
+	inflateEnd(&z->inf);
+	free(z->buf);
+	free(z);
+}
+
+/* compresses a message and updates len; returns NULL if it is to be sent as is */
+const unsigned char *
+wsdeflate(struct wsdeflate *z, const unsigned char *buf, size_t *len)
+{
+	unsigned char *newbuf;
+	size_t n, cap;
+
+	if (*len < deflatemin)
+		return NULL;
+	z->def.next_in = (unsigned char *)buf;
+	z->def.avail_in = *len;
+	n = 0;
+	do {
+		if (z->bufcap - n < 64) {
+			cap = z->bufcap ? z->bufcap * 2 : 4096;
+			newbuf = realloc(z->buf, cap);
+			if (!newbuf)
+				fatal("realloc:");
+			z->buf = newbuf;
+			z->bufcap = cap;
+		}
+		z->def.next_out = z->buf + n;
+		z->def.avail_out = z->bufcap - n;
+		if (deflate(&z->def, Z_SYNC_FLUSH) == Z_STREAM_ERROR)
+			fatal("deflate failed");
+		n = z->bufcap - z->def.avail_out;
+	} while (z->def.avail_out == 0);
+	if (z->notakeover)
+		deflateReset(&z->def);
+	/* the flush ends with an empty block, 00 00 ff ff, which is left off */
+	*len = n - 4;
+	return z->buf;
+}
+
+/* decompresses a message into out; returns its length, or -1 if it is invalid or too large */
+long
+wsinflate(struct wsdeflate *z, const unsigned char *buf, size_t len, unsigned char *out, size_t outlen)
+{
+	static const unsigned char tail[] = {0x00, 0x00, 0xff, 0xff};
+	int ret;
+
+	z->inf.next_out = out;
+	z->inf.avail_out = outlen;
+	z->inf.next_in = (unsigned char *)buf;
+	z->inf.avail_in = len;
+	ret = inflate(&z->inf, Z_SYNC_FLUSH);
+	if (ret == Z_OK || ret == Z_BUF_ERROR) {
+		/* input left over means the output is full */
+		if (z->inf.avail_in > 0)
+			return -1;
+		z->inf.next_in = (unsigned char *)tail;
+		z->inf.avail_in = sizeof tail;
+		ret = inflate(&z->inf, Z_SYNC_FLUSH);
+	}
+	if (ret == Z_STREAM_END) {
+		inflateReset(&z->inf);
+		ret = Z_OK;
+	}
+	if ((ret != Z_OK && ret != Z_BUF_ERROR) || z->inf.avail_out == 0)
+		return -1;
+	return outlen - z->inf.avail_out;
+}
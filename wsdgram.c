@@ -1,114 +1,64 @@
 #define _POSIX_C_SOURCE 200809L
 #include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <poll.h>
 #include <pthread.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include "arg.h"
-#include "base64.h"
 #include "http.h"
+#include "httpfile.h"
 #include "intpack.h"
-#include "sha1.h"
 #include "socket.h"
+#include "stream.h"
 #include "util.h"
-
-enum {
-	CLOSE = 0x8,
-	PING = 0x9,
-	PONG = 0xa,
-};
+#include "ws.h"
 
 static int rfd;
 static int wfd;
 static bool closing;
+/* WebSocket clients accepted on the listen address */
+static struct stream **conns;
+static size_t connslen, connscap;
+static unsigned long accepted;
+static volatile sig_atomic_t dumpstats;
 
 static void
 usage(void)
 {
-	fprintf(stderr, "usage: wsdgram [-m] [-s addr] [-r addr]\n");
+	fprintf(stderr, "usage: wsdgram [-m] [-l addr [-W webdir] [-z level[,minbytes]]] [-s addr] [-r addr]\n");
 	exit(1);
 }
 
 static void
 handshake(FILE *rd, FILE *wr)
 {
-	static const char response[] =
-		"HTTP/1.1 101 Switching Protocols\r\n"
-		"Upgrade: websocket\r\n"
-		"Connection: Upgrade\r\n";
-	struct http_request req;
-	struct http_header hdr;
-	bool websocket, upgrade, havekey;
-	long version;
-	char *token;
-	unsigned char sha1[20];
-	char accept[(sizeof sha1 + 2) / 3 * 4 + 1], buf[2048];
-
-	if (!fgets(buf, sizeof buf, rd)) {
-		if (ferror(rd))
-			perror("read");
-		goto fail;
-	}
-	if (http_request(buf, strlen(buf), &req) != 0)
-		goto fail;
-	if (req.method != HTTP_GET)
-		goto fail;
-	upgrade = false;
-	websocket = false;
-	havekey = true;
-	version = 0;
-	for (;;) {
+	struct wsrequest req = {0};
+	char buf[2048];
+	int ret;
+
+	do {
 		if (!fgets(buf, sizeof buf, rd)) {
 			if (ferror(rd))
 				perror("read");
 			goto fail;
 		}
-		if (http_header(buf, strlen(buf), &hdr) != 0)
+		ret = wsrequestline(&req, buf, strlen(buf));
+		if (ret < 0)
 			goto fail;
-		if (!hdr.name)
-			break;
-		if (strcmp(hdr.name, "Upgrade") == 0) {
-			for (token = strtok(hdr.value, " \t,"); token; token = strtok(NULL, " \t,")) {
-				if (strcmp(token, "websocket") == 0) {
-					websocket = true;
-					break;
-				}
-			}
-		} else if (strcmp(hdr.name, "Connection") == 0) {
-			for (token = strtok(hdr.value, " \t,"); token; token = strtok(NULL, " \t,")) {
-				if (strcmp(token, "Upgrade") == 0) {
-					upgrade = true;
-					break;
-				}
-			}
-		} else if (strcmp(hdr.name, "Sec-WebSocket-Key") == 0) {
-			static const char guid[36] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
-			sha1_context ctx;
-
-			if (hdr.value_len != (16 + 2) / 3 * 4)
-				goto fail;
-			sha1_init(&ctx);
-			sha1_update(&ctx, hdr.value, hdr.value_len);
-			sha1_update(&ctx, guid, sizeof guid);
-			sha1_out(&ctx, sha1);
-			base64_encode(accept, sha1, sizeof sha1);
-			havekey = true;
-		} else if (strcmp(hdr.name, "Sec-WebSocket-Version") == 0) {
-			char *end;
-
-			version = strtol(hdr.value, &end, 10);
-			if (hdr.value_len == 0 || hdr.value_len != end - hdr.value)
-				goto fail;
-		}
-	}
-
-	if (!upgrade || !websocket || !havekey || version != 13)
+	} while (ret == 0);
+	ret = wsresponse(&req, buf, sizeof buf);
+	if (ret < 0)
 		goto fail;
-	fwrite(response, 1, sizeof response - 1, wr);
-	fprintf(wr, "Sec-WebSocket-Accept: %s\r\n\r\n", accept);
+	fwrite(buf, 1, ret, wr);
 	fflush(wr);
 	return;
 
@@ -117,31 +67,34 @@ fail:
 	exit(1);
 }
 
+/* the frame goes out in one writev, bypassing the stdio buffer */
 static void
 writeframe(FILE *wr, int op, const void *buf, size_t len)
 {
-	unsigned char hdr[10];
-	int hdrlen;
+	unsigned char hdr[WS_HDRMAX];
+	struct iovec iov[2], *pos;
+	ssize_t ret;
 
-	hdr[0] = 0x80 | op;
-	if (len < 126) {
-		hdr[1] = len;
-		hdrlen = 2;
-	} else if (len <= 0xffff) {
-		hdr[1] = 126;
-		putbe16(hdr + 2, len);
-		hdrlen = 4;
-	} else {
-		hdr[1] = 127;
-		putbe64(hdr + 2, len);
-		hdrlen = 10;
-	}
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = wsframehdr(hdr, op, len);
+	iov[1].iov_base = (void *)buf;
+	iov[1].iov_len = len;
+	pos = iov;
 	flockfile(wr);
-	if (!closing) {
-		if (fwrite(hdr, 1, hdrlen, wr) != hdrlen || fwrite(buf, 1, len, wr) != len || fflush(wr) != 0) {
+	while (!closing && pos < iov + 2) {
+		ret = writev(fileno(wr), pos, iov + 2 - pos);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
 			perror("write:");
 			exit(1);
 		}
+		for (; pos < iov + 2 && ret >= pos->iov_len; ++pos)
+			ret -= pos->iov_len;
+		if (pos < iov + 2) {
+			pos->iov_base = (unsigned char *)pos->iov_base + ret;
+			pos->iov_len -= ret;
+		}
 	}
 	funlockfile(wr);
 }
@@ -154,12 +107,40 @@ writeclose(FILE *wr, int code)
 	if (!closing) {
 		putbe16(buf, code);
 		flockfile(wr);
-		writeframe(wr, CLOSE, buf, sizeof buf);
+		writeframe(wr, WS_CLOSE, buf, sizeof buf);
 		closing = true;
 		funlockfile(wr);
 	}
 }
 
+/* asks for the bundles missing before a sequenced one from a multicast group */
+static void
+checkseq(const unsigned char *buf, size_t len)
+{
+	static bool synced;
+	static uint32_t next;
+	unsigned char nack[20] = "/nack\0\0\0,ii";
+	uint32_t seq;
+
+	if (len < 36 || memcmp(buf, "#bundle", 8) != 0 || memcmp(buf + 20, "/seq\0\0\0\0,i\0\0", 12) != 0)
+		return;
+	seq = getbe32(buf + 32);
+	if (synced && seq != next) {
+		if (seq - next < 0x80000000) {
+			putbe32(nack + 12, next);
+			putbe32(nack + 16, seq - 1);
+			if (write(wfd, nack, sizeof nack) < 0 && errno != ECONNREFUSED)
+				perror("write");
+		} else if (next - seq <= 1024) {
+			/* late or duplicated */
+			return;
+		}
+		/* otherwise, the sender restarted */
+	}
+	synced = true;
+	next = seq + 1;
+}
+
 static void
 writer(FILE *wr)
 {
@@ -177,7 +158,8 @@ writer(FILE *wr)
 			writeclose(wr, 1001);
 			break;
 		}
-		writeframe(wr, 2, buf, ret);
+		checkseq(buf, ret);
+		writeframe(wr, WS_BINARY, buf, ret);
 	}
 }
 
@@ -188,61 +170,48 @@ writermain(void *arg)
 	return NULL;
 }
 
-static void
-unmask(unsigned char *buf, size_t len, unsigned char key[static 4])
-{
-	size_t i;
-
-	for (i = 0; i < len; ++i)
-		buf[i] ^= key[i & 3];
-}
-
 static void
 reader(FILE *rd, FILE *wr)
 {
-	unsigned char hdr[2], lenbuf[8], key[4], ctl[125], msg[4096];
+	unsigned char hdr[WS_HDRMAX], ctl[125], msg[4096];
+	struct wsframe f;
 	int msglen;
+	size_t hdrlen;
 	unsigned long long len;
-	bool masked, skip;
+	bool skip;
 
 	skip = false;
 	msglen = 0;
 	for (;;) {
-		if (fread(hdr, 1, sizeof hdr, rd) != sizeof hdr)
+		if (fread(hdr, 1, 2, rd) != 2)
 			break;
-		len = hdr[1] & 0x7f;
-		if (len == 126) {
-			if (fread(lenbuf, 1, 2, rd) != 2)
-				break;
-			len = getbe16(lenbuf);
-		} else if (len == 127) {
-			if (fread(lenbuf, 1, 8, rd) != 8)
-				break;
-			len = getbe64(lenbuf);
-		}
-		masked = hdr[1] & 0x80;
-		if (masked && fread(key, 1, sizeof key, rd) != sizeof key)
+		hdrlen = 2;
+		hdrlen += (hdr[1] & 0x7f) == 126 ? 2 : (hdr[1] & 0x7f) == 127 ? 8 : 0;
+		hdrlen += hdr[1] & 0x80 ? 4 : 0;
+		if (fread(hdr + 2, 1, hdrlen - 2, rd) != hdrlen - 2)
 			break;
-		if (hdr[0] & 0x8) {
+		wsframeparse(hdr, hdrlen, &f);
+		len = f.len;
+		if (f.op & 0x8) {
 			/* control frame */
-			if ((hdr[0] & 0x80) == 0 || len >= 126) {
+			if (!f.fin || len >= 126) {
 				writeclose(wr, 1002);
 				exit(1);
 			}
 			if (fread(ctl, 1, len, rd) != len)
 				break;
-			if (masked)
-				unmask(ctl, len, key);
-			switch (hdr[0] & 0xf) {
-			case CLOSE:
+			if (f.masked)
+				wsunmask(ctl, len, f.key);
+			switch (f.op) {
+			case WS_CLOSE:
 				flockfile(wr);
-				writeframe(wr, CLOSE, ctl, len > 2 ? 2 : len);
+				writeframe(wr, WS_CLOSE, ctl, len > 2 ? 2 : len);
 				exit(0);
 				break;
-			case PING:
-				writeframe(wr, PONG, ctl, len);
+			case WS_PING:
+				writeframe(wr, WS_PONG, ctl, len);
 				break;
-			case PONG:
+			case WS_PONG:
 				/* ignore */
 				break;
 			}
@@ -262,16 +231,17 @@ reader(FILE *rd, FILE *wr)
 			}
 			if (fread(msg + msglen, 1, len, rd) != len)
 				break;
+			/* each fragment has its own key */
+			if (f.masked)
+				wsunmask(msg + msglen, len, f.key);
 			msglen += len;
-			if (hdr[0] & 0x80) {
+			if (f.fin) {
 				ssize_t ret;
 
 				if (skip) {
 					skip = false;
 					continue;
 				}
-				if (masked)
-					unmask(msg, msglen, key);
 				ret = write(wfd, msg, msglen);
 				if (ret <= 0) {
 					if (errno != ECONNREFUSED) {
@@ -294,20 +264,170 @@ done:
 	exit(0);
 }
 
+static void
+forward(const unsigned char *buf, size_t len)
+{
+	ssize_t ret;
+
+	ret = write(wfd, buf, len);
+	if (ret < 0 && errno != ECONNREFUSED)
+		perror("write");
+}
+
+static void
+acceptconn(int lfd)
+{
+	struct stream **newconns;
+	size_t cap;
+	int fd, flags;
+
+	fd = accept(lfd, NULL, NULL);
+	if (fd < 0) {
+		if (errno != EAGAIN && errno != ECONNABORTED && errno != EINTR)
+			perror("accept");
+		return;
+	}
+	flags = fcntl(fd, F_GETFL);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+		perror("fcntl");
+		close(fd);
+		return;
+	}
+	socknodelay(fd);
+	if (connslen == connscap) {
+		cap = connscap ? connscap * 2 : 8;
+		newconns = realloc(conns, cap * sizeof *conns);
+		if (!newconns)
+			fatal("realloc:");
+		conns = newconns;
+		connscap = cap;
+	}
+	conns[connslen++] = streamopen(fd, FRAME_WS);
+	++accepted;
+}
+
+static void
+reapconns(void)
+{
+	size_t i, j;
+
+	for (i = 0, j = 0; i < connslen; ++i) {
+		if (conns[i]->dead)
+			streamclose(conns[i]);
+		else
+			conns[j++] = conns[i];
+	}
+	connslen = j;
+}
+
+static void
+report(FILE *fp)
+{
+	size_t i;
+
+	fprintf(fp, "%zu connections, %lu accepted\n", connslen, accepted);
+	for (i = 0; i < connslen; ++i)
+		fprintf(fp, "fd %d: %zu bytes queued, %lu level packets dropped%s\n", conns[i]->fd, streamqueued(conns[i]), conns[i]->metersdropped, conns[i]->upgraded ? "" : ", upgrading");
+	fflush(fp);
+}
+
+static void
+sighandler(int sig)
+{
+	dumpstats = 1;
+}
+
+/* serves any number of clients, sharing the UDP sockets between them */
+static void
+serve(int lfd)
+{
+	static unsigned char buf[65536];
+	struct sigaction sa;
+	struct pollfd *pfd;
+	size_t i, n, pfdlen;
+	ssize_t ret;
+
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = sighandler;
+	sa.sa_flags = SA_RESTART;
+	if (sigaction(SIGUSR1, &sa, NULL) != 0)
+		fatal("sigaction:");
+	pfd = NULL;
+	pfdlen = 0;
+	for (;;) {
+		reapconns();
+		n = connslen;
+		if (pfdlen < 2 + n) {
+			pfdlen = 2 + n * 2;
+			free(pfd);
+			pfd = calloc(pfdlen, sizeof *pfd);
+			if (!pfd)
+				fatal("calloc:");
+		}
+		pfd[0].fd = lfd;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = rfd;
+		pfd[1].events = POLLIN;
+		for (i = 0; i < n; ++i) {
+			pfd[2 + i].fd = conns[i]->fd;
+			pfd[2 + i].events = 0;
+			if (streamqueued(conns[i]) < STREAMHIGH)
+				pfd[2 + i].events |= POLLIN;
+			if (streamqueued(conns[i]) > 0)
+				pfd[2 + i].events |= POLLOUT;
+		}
+		if (poll(pfd, 2 + n, -1) < 0) {
+			if (errno != EINTR)
+				fatal("poll:");
+			n = 0;
+			pfd[0].revents = 0;
+			pfd[1].revents = 0;
+		}
+		for (i = 0; i < n; ++i) {
+			if (pfd[2 + i].revents & (POLLIN | POLLHUP | POLLERR))
+				streamread(conns[i], forward);
+			if (pfd[2 + i].revents & POLLOUT && !conns[i]->dead)
+				streamflush(conns[i]);
+		}
+		if (pfd[1].revents & POLLIN) {
+			/* each packet is read once and queued for every client */
+			ret = read(rfd, buf, sizeof buf);
+			if (ret < 0) {
+				if (errno != EINTR && errno != EAGAIN)
+					fatal("read:");
+			} else {
+				checkseq(buf, ret);
+				for (i = 0; i < n; ++i)
+					streamwrite(conns[i], buf, ret);
+			}
+		}
+		if (pfd[0].revents & POLLIN)
+			acceptconn(lfd);
+		if (dumpstats) {
+			dumpstats = 0;
+			report(stderr);
+		}
+	}
+}
+
 int
 main(int argc, char *argv[])
 {
 	static char mcastaddr[] = "udp!224.0.0.1!8222";
 	static char defrecvaddr[] = "udp!127.0.0.1!8222";
 	static char defsendaddr[] = "udp!127.0.0.1!7222";
-	int err;
-	char *recvaddr, *sendaddr;
+	int err, lfd, framing;
+	char *recvaddr, *sendaddr, *listenaddr;
 	pthread_t thread;
 
 	recvaddr = defrecvaddr;
 	sendaddr = defsendaddr;
+	listenaddr = NULL;
 
 	ARGBEGIN {
+	case 'l':
+		listenaddr = EARGF(usage());
+		break;
 	case 'r':
 		recvaddr = EARGF(usage());
 		break;
@@ -317,14 +437,29 @@ main(int argc, char *argv[])
 	case 'm':
 		recvaddr = mcastaddr;
 		break;
+	case 'W':
+		httpfileroot(EARGF(usage()));
+		break;
+	case 'z':
+		wsdeflateinit(EARGF(usage()));
+		break;
 	} ARGEND;
 
-	if (argc != 0)
+	/* only the listening mode implements compression and serves files */
+	if (argc != 0 || ((wsdeflatelevel >= 0 || httpfiledir >= 0) && !listenaddr))
 		usage();
 
-	rfd = sockopen(recvaddr, 1);
-	wfd = sockopen(sendaddr, 0);
+	rfd = sockopen(recvaddr, 1, NULL);
+	wfd = sockopen(sendaddr, 0, NULL);
 
+	if (listenaddr) {
+		lfd = sockopen(listenaddr, 1, &framing);
+		if (framing != FRAME_WS)
+			fatal("listen address must be a ws address");
+		serve(lfd);
+	}
+	/* frame headers are parsed from a buffer this large */
+	setvbuf(stdin, NULL, _IOFBF, 65536);
 	handshake(stdin, stdout);
 	err = pthread_create(&thread, NULL, writermain, stdout);
 	if (err)
@@ -0,0 +1,35 @@
+#include <stddef.h>
+#include "util.h"
+#include "ws.h"
+
+int wsdeflatelevel = -1;
+const bool wsdeflatesupported = false;
+
+void
+wsdeflateinit(const char *opt)
+{
+	fatal("permessage-deflate is not supported; build with ZLIB=y");
+}
+
+struct wsdeflate *
+wsdeflatenew(const struct wsrequest *req)
+{
+	return NULL;
+}
+
+void
+wsdeflatefree(struct wsdeflate *z)
+{
+}
+
+const unsigned char *
+wsdeflate(struct wsdeflate *z, const unsigned char *buf, size_t *len)
+{
+	return NULL;
+}
+
+long
+wsinflate(struct wsdeflate *z, const unsigned char *buf, size_t len, unsigned char *out, size_t outlen)
+{
+	return -1;
+}